@@ -0,0 +1,136 @@
+/*
+ * Convolution IR Reader
+ * Copyright (C) 2022-2023 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: ISC
+ */
+
+#pragma once
+
+#include "extra/String.hpp"
+
+#include "dr_flac.h"
+#include "dr_wav.h"
+
+#include <strings.h>
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// Reads an IR file (wav or flac) in chunks of interleaved float frames, without ever decoding it all at once.
+
+class ConvolutionIRReader
+{
+public:
+    ConvolutionIRReader()
+        : flac(nullptr),
+          wavOpen(false),
+          numChannels(0),
+          sampleRate(0),
+          numFrames(0) {}
+
+    ~ConvolutionIRReader()
+    {
+        close();
+    }
+
+    bool open(const char* const filename)
+    {
+        close();
+
+        const size_t filenamelen = std::strlen(filename);
+
+        if (filenamelen >= 5 && ::strncasecmp(filename + (filenamelen - 5), ".flac", 5) == 0)
+        {
+            flac = drflac_open_file(filename, nullptr);
+            DISTRHO_SAFE_ASSERT_RETURN(flac != nullptr, false);
+
+            numChannels = flac->channels;
+            sampleRate = flac->sampleRate;
+            numFrames = flac->totalPCMFrameCount;
+        }
+        else
+        {
+            DISTRHO_SAFE_ASSERT_RETURN(drwav_init_file(&wav, filename, nullptr), false);
+
+            wavOpen = true;
+            numChannels = wav.channels;
+            sampleRate = wav.sampleRate;
+            numFrames = wav.totalPCMFrameCount;
+        }
+
+        if (numChannels == 0 || sampleRate == 0)
+        {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void close()
+    {
+        if (flac != nullptr)
+        {
+            drflac_close(flac);
+            flac = nullptr;
+        }
+
+        if (wavOpen)
+        {
+            drwav_uninit(&wav);
+            wavOpen = false;
+        }
+
+        numChannels = sampleRate = 0;
+        numFrames = 0;
+    }
+
+    // move to frame `frame`, the next read starts from there
+    bool seek(const size_t frame)
+    {
+        if (flac != nullptr)
+            return drflac_seek_to_pcm_frame(flac, frame);
+        if (wavOpen)
+            return drwav_seek_to_pcm_frame(&wav, frame);
+        return false;
+    }
+
+    // read up to `frames` interleaved frames into `buffer`, returns the amount of frames read, 0 on end of file
+    size_t read(float* const buffer, const size_t frames)
+    {
+        if (flac != nullptr)
+            return static_cast<size_t>(drflac_read_pcm_frames_f32(flac, frames, buffer));
+        if (wavOpen)
+            return static_cast<size_t>(drwav_read_pcm_frames_f32(&wav, frames, buffer));
+        return 0;
+    }
+
+    uint getNumChannels() const noexcept
+    {
+        return numChannels;
+    }
+
+    uint getSampleRate() const noexcept
+    {
+        return sampleRate;
+    }
+
+    size_t getNumFrames() const noexcept
+    {
+        return static_cast<size_t>(numFrames);
+    }
+
+private:
+    drflac* flac;
+    drwav wav;
+    bool wavOpen;
+    uint numChannels;
+    uint sampleRate;
+    uint64_t numFrames;
+
+    DISTRHO_DECLARE_NON_COPYABLE(ConvolutionIRReader)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
@@ -0,0 +1,587 @@
+/*
+ * Convolution Kernel
+ * Copyright (C) 2022-2023 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: ISC
+ */
+
+#pragma once
+
+#include "extra/String.hpp"
+
+#include "FFTConvolver/AudioFFT.h"
+#include "FFTConvolver/Utilities.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// How an IR is split into stages of uniformly sized partitions, and how their spectra are stored.
+// Stage N uses blocks of `headBlockSize * stageGrowthFactor^N` samples, with every stage after the 1st one
+// starting at an IR offset of 2 of its own blocks.
+//
+// Compact spectra are stored as bfloat16, half the memory (and memory bandwidth) of regular floats.
+// Values keep the full float range but only 8 bits of precision, rounding each one by up to 2^-9 (about -54 dB).
+// Approximate figures from comparing the output to a double precision direct convolution on a decaying noise IR:
+// the error is roughly 55 dB under the output level, and 140 dB with regular floats.
+
+struct ConvolutionLayout {
+    uint32_t headBlockSize;
+    uint32_t stageGrowthFactor;
+    uint32_t maxStages;
+    bool compactSpectra;
+
+    ConvolutionLayout() noexcept
+        : headBlockSize(128),
+          stageGrowthFactor(8),
+          maxStages(4),
+          compactSpectra(false) {}
+
+    bool operator==(const ConvolutionLayout& other) const noexcept
+    {
+        return headBlockSize == other.headBlockSize &&
+               stageGrowthFactor == other.stageGrowthFactor &&
+               maxStages == other.maxStages &&
+               compactSpectra == other.compactSpectra;
+    }
+
+    bool operator!=(const ConvolutionLayout& other) const noexcept
+    {
+        return !operator==(other);
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// Immutable, frequency-domain partitioned IR for a single channel.
+// Can be shared between any number of convolvers, which keep their own input and overlap state.
+//
+// Leading silence trimmed from the IR is kept as a delay, to be applied by the convolver on its input.
+
+class ConvolutionKernel
+{
+public:
+    static constexpr const size_t kMaxStages = 6;
+
+    // energy relative to the whole IR under which partitions are considered silent, -120 dB
+    static constexpr const double kSilentPartitionEnergy = 1e-12;
+
+    // bfloat16, the upper half of a float
+    typedef uint16_t CompactSample;
+
+    static CompactSample toCompact(const float value) noexcept
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+
+        // round to nearest even
+        bits += 0x7fff + ((bits >> 16) & 1);
+        return static_cast<CompactSample>(bits >> 16);
+    }
+
+    static float fromCompact(const CompactSample value) noexcept
+    {
+        const uint32_t bits = static_cast<uint32_t>(value) << 16;
+        float result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    struct Stage {
+        size_t blockSize;
+        size_t irOffset;
+        size_t numPartitions;
+        size_t complexSize;
+
+        // spectra of all partitions, stored back to back, in either regular or compact form.
+        // either pointing to our own buffers below or to externally owned (memory-mapped) storage
+        bool compact;
+        const fftconvolver::Sample* reData;
+        const fftconvolver::Sample* imData;
+        const CompactSample* reCompactData;
+        const CompactSample* imCompactData;
+
+        // indices of the partitions that are not silent, in increasing order, the others can be skipped
+        const uint32_t* activeData;
+        size_t numActive;
+
+        Stage()
+            : blockSize(0),
+              irOffset(0),
+              numPartitions(0),
+              complexSize(0),
+              compact(false),
+              reData(nullptr),
+              imData(nullptr),
+              reCompactData(nullptr),
+              imCompactData(nullptr),
+              activeData(nullptr),
+              numActive(0) {}
+
+        const fftconvolver::Sample* partitionRe(const size_t index) const noexcept
+        {
+            return reData + index * complexSize;
+        }
+
+        const fftconvolver::Sample* partitionIm(const size_t index) const noexcept
+        {
+            return imData + index * complexSize;
+        }
+
+        const CompactSample* compactPartitionRe(const size_t index) const noexcept
+        {
+            return reCompactData + index * complexSize;
+        }
+
+        const CompactSample* compactPartitionIm(const size_t index) const noexcept
+        {
+            return imCompactData + index * complexSize;
+        }
+
+        // allocate zeroed spectra for an IR segment of `irLen` samples, to be filled by `transform`
+        void init(const size_t blockSize_, const size_t irOffset_, const size_t irLen, const bool compact_)
+        {
+            blockSize = blockSize_;
+            irOffset = irOffset_;
+            numPartitions = (irLen + blockSize_ - 1) / blockSize_;
+            complexSize = audiofft::AudioFFT::ComplexSize(blockSize_ * 2);
+            compact = compact_;
+
+            if (compact)
+            {
+                reCompact.assign(numPartitions * complexSize, 0);
+                imCompact.assign(numPartitions * complexSize, 0);
+
+                reCompactData = reCompact.data();
+                imCompactData = imCompact.data();
+            }
+            else
+            {
+                re.resize(numPartitions * complexSize);
+                im.resize(numPartitions * complexSize);
+
+                reData = re.data();
+                imData = im.data();
+            }
+
+            // everything is active until told otherwise
+            active.resize(numPartitions);
+            for (size_t p = 0; p < numPartitions; ++p)
+                active[p] = static_cast<uint32_t>(p);
+
+            activeData = active.data();
+            numActive = active.size();
+        }
+
+        // transform a zero-padded time-domain block of `blockSize * 2` samples into partition `index`.
+        // compact stages go through `scratch` first, which must hold `complexSize` values.
+        void transform(audiofft::AudioFFT& fft, const size_t index, const fftconvolver::Sample* const block,
+                       fftconvolver::SplitComplex& scratch)
+        {
+            if (! compact)
+            {
+                fft.fft(block, re.data() + index * complexSize, im.data() + index * complexSize);
+                return;
+            }
+
+            fft.fft(block, scratch.re(), scratch.im());
+
+            CompactSample* const outRe = reCompact.data() + index * complexSize;
+            CompactSample* const outIm = imCompact.data() + index * complexSize;
+
+            for (size_t k = 0; k < complexSize; ++k)
+            {
+                outRe[k] = toCompact(scratch.re()[k]);
+                outIm[k] = toCompact(scratch.im()[k]);
+            }
+        }
+
+        // mix partition `index` of `from` and `to` into the same partition of this stage, `amount` of the way to `to`.
+        // all must have the same block size, a null stage or one with fewer partitions counts as silence there.
+        // only for stages with regular spectra of their own.
+        void blend(const size_t index, const Stage* const from, const Stage* const to, const float amount) noexcept
+        {
+            fftconvolver::Sample* const outRe = re.data() + index * complexSize;
+            fftconvolver::Sample* const outIm = im.data() + index * complexSize;
+
+            std::memset(outRe, 0, sizeof(fftconvolver::Sample) * complexSize);
+            std::memset(outIm, 0, sizeof(fftconvolver::Sample) * complexSize);
+
+            accumulate(outRe, outIm, from, index, 1.f - amount);
+            accumulate(outRe, outIm, to, index, amount);
+        }
+
+        // whether partition `index` exists and is not silent
+        bool isActive(const size_t index) const noexcept
+        {
+            return std::binary_search(activeData, activeData + numActive, static_cast<uint32_t>(index));
+        }
+
+        // keep only the partitions for which `isActive(index)` returns true
+        template<typename IsActive>
+        void filterActive(const IsActive& isActive)
+        {
+            active.erase(std::remove_if(active.begin(), active.end(),
+                                        [&isActive](const uint32_t index) { return !isActive(index); }),
+                         active.end());
+
+            activeData = active.data();
+            numActive = active.size();
+        }
+
+    private:
+        fftconvolver::SampleBuffer re;
+        fftconvolver::SampleBuffer im;
+
+        // add partition `index` of `stage` times `gain` to a spectrum, if it has that partition
+        static void accumulate(fftconvolver::Sample* const outRe, fftconvolver::Sample* const outIm,
+                               const Stage* const stage, const size_t index, const float gain) noexcept
+        {
+            if (stage == nullptr || index >= stage->numPartitions || gain == 0.f)
+                return;
+
+            const size_t size = stage->complexSize;
+
+            if (stage->compact)
+            {
+                const CompactSample* const inRe = stage->compactPartitionRe(index);
+                const CompactSample* const inIm = stage->compactPartitionIm(index);
+
+                for (size_t k = 0; k < size; ++k)
+                {
+                    outRe[k] += fromCompact(inRe[k]) * gain;
+                    outIm[k] += fromCompact(inIm[k]) * gain;
+                }
+            }
+            else
+            {
+                const fftconvolver::Sample* const inRe = stage->partitionRe(index);
+                const fftconvolver::Sample* const inIm = stage->partitionIm(index);
+
+                for (size_t k = 0; k < size; ++k)
+                {
+                    outRe[k] += inRe[k] * gain;
+                    outIm[k] += inIm[k] * gain;
+                }
+            }
+        }
+        std::vector<CompactSample> reCompact;
+        std::vector<CompactSample> imCompact;
+        std::vector<uint32_t> active;
+
+        DISTRHO_DECLARE_NON_COPYABLE(Stage)
+    };
+
+    // Builds a kernel from an IR fed in pieces of any size, transforming every partition as soon as it is complete.
+    // Only a single time-domain block of the current stage is kept around, never the whole IR.
+    class Builder
+    {
+    public:
+        // `untrimmedLength` is only informative, the length of the IR before any trimming (including `delay`)
+        Builder(const ConvolutionLayout& layout, const size_t irLen, const size_t delay = 0,
+                const size_t untrimmedLength = 0)
+            : position(0),
+              stageIndex(0),
+              partitionIndex(0)
+        {
+            DISTRHO_SAFE_ASSERT_RETURN(layout.headBlockSize != 0,);
+            DISTRHO_SAFE_ASSERT_RETURN(layout.stageGrowthFactor > 1,);
+            DISTRHO_SAFE_ASSERT_RETURN(layout.maxStages != 0 && layout.maxStages <= kMaxStages,);
+
+            kernel.reset(new ConvolutionKernel(layout, irLen, delay, std::max(untrimmedLength, delay + irLen)));
+            kernel->initStages();
+
+            beginStage();
+        }
+
+        // append the next `count` samples of the IR, anything past its length is ignored
+        void write(const fftconvolver::Sample* samples, size_t count)
+        {
+            DISTRHO_SAFE_ASSERT_RETURN(kernel != nullptr,);
+
+            while (count != 0 && stageIndex < kernel->numStages)
+            {
+                const Stage& stage(kernel->stages[stageIndex]);
+                const size_t partitionStart = stage.irOffset + partitionIndex * stage.blockSize;
+                const size_t partitionEnd = std::min(partitionStart + stage.blockSize, kernel->irLength);
+                const size_t todo = std::min(count, partitionEnd - position);
+
+                std::memcpy(fftBuffer.data() + (position - partitionStart), samples,
+                            sizeof(fftconvolver::Sample) * todo);
+
+                position += todo;
+                samples += todo;
+                count -= todo;
+
+                if (position == partitionEnd)
+                    finishPartition();
+            }
+        }
+
+        // zero-pad whatever was not written yet and return the completed kernel
+        std::shared_ptr<const ConvolutionKernel> finish()
+        {
+            DISTRHO_SAFE_ASSERT_RETURN(kernel != nullptr, nullptr);
+
+            while (stageIndex < kernel->numStages)
+            {
+                const Stage& stage(kernel->stages[stageIndex]);
+                position = std::min(stage.irOffset + (partitionIndex + 1) * stage.blockSize, kernel->irLength);
+                finishPartition();
+            }
+
+            // partitions are skipped only if all of them together stay under the threshold
+            double totalEnergy = 0.0;
+            for (const double energy : energies)
+                totalEnergy += energy;
+
+            const double maxEnergy = totalEnergy * kSilentPartitionEnergy / std::max<size_t>(1, energies.size());
+
+            for (size_t s = 0, first = 0; s < kernel->numStages; first += kernel->stages[s++].numPartitions)
+            {
+                kernel->stages[s].filterActive([this, first, maxEnergy](const uint32_t index) {
+                    return energies[first + index] > maxEnergy;
+                });
+            }
+
+            std::shared_ptr<const ConvolutionKernel> result(kernel);
+            kernel.reset();
+            return result;
+        }
+
+    private:
+        std::shared_ptr<ConvolutionKernel> kernel;
+        audiofft::AudioFFT fft;
+        fftconvolver::SampleBuffer fftBuffer;
+        fftconvolver::SplitComplex spectrum;
+        size_t position;
+        size_t stageIndex;
+        size_t partitionIndex;
+
+        // time-domain energy of every partition of every stage, in order
+        std::vector<double> energies;
+
+        void beginStage()
+        {
+            // only an empty IR has stages without partitions
+            while (stageIndex < kernel->numStages && kernel->stages[stageIndex].numPartitions == 0)
+                ++stageIndex;
+
+            if (stageIndex == kernel->numStages)
+                return;
+
+            const size_t blockSize = kernel->stages[stageIndex].blockSize;
+            fft.init(blockSize * 2);
+            fftBuffer.resize(blockSize * 2);
+
+            if (kernel->stages[stageIndex].compact)
+                spectrum.resize(kernel->stages[stageIndex].complexSize);
+        }
+
+        void finishPartition()
+        {
+            Stage& stage(kernel->stages[stageIndex]);
+
+            double energy = 0.0;
+            for (size_t i = 0; i < stage.blockSize; ++i)
+                energy += static_cast<double>(fftBuffer[i]) * fftBuffer[i];
+            energies.push_back(energy);
+
+            stage.transform(fft, partitionIndex, fftBuffer.data(), spectrum);
+            fftBuffer.setZero();
+
+            if (++partitionIndex == stage.numPartitions)
+            {
+                partitionIndex = 0;
+                ++stageIndex;
+                beginStage();
+            }
+        }
+
+        DISTRHO_DECLARE_NON_COPYABLE(Builder)
+    };
+
+    // `untrimmedLength` is only informative, the length of the IR before any trimming (including `delay`)
+    static std::shared_ptr<const ConvolutionKernel> create(const fftconvolver::Sample* const ir,
+                                                           const size_t irLen,
+                                                           const ConvolutionLayout& layout,
+                                                           const size_t delay = 0,
+                                                           const size_t untrimmedLength = 0)
+    {
+        Builder builder(layout, irLen, delay, untrimmedLength);
+        builder.write(ir, irLen);
+        return builder.finish();
+    }
+
+    // Kernel of `irLen` samples mixing `from` and `to`, either of which can be null, for morphing between them.
+    // Starts out `amount` of the way to `to`, its partitions can be mixed again later with `Stage::blend`.
+    // Both must share the same partition sizes and be no longer than `irLen`, the shorter one counts as silence
+    // past its end, and partitions silent in both are left out.
+    // The given `delay` replaces their own, which aligns their onsets.
+    // The result always has regular spectra, even if mixed from compact ones.
+    static std::shared_ptr<ConvolutionKernel> createBlend(const ConvolutionKernel* const from,
+                                                          const ConvolutionKernel* const to,
+                                                          const float amount,
+                                                          const size_t irLen,
+                                                          const size_t delay)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(from != nullptr || to != nullptr, nullptr);
+        DISTRHO_SAFE_ASSERT_RETURN(from == nullptr || from->irLength <= irLen, nullptr);
+        DISTRHO_SAFE_ASSERT_RETURN(to == nullptr || to->irLength <= irLen, nullptr);
+        DISTRHO_SAFE_ASSERT_RETURN(from == nullptr || to == nullptr ||
+                                   (from->layout.headBlockSize == to->layout.headBlockSize &&
+                                    from->layout.stageGrowthFactor == to->layout.stageGrowthFactor &&
+                                    from->layout.maxStages == to->layout.maxStages), nullptr);
+
+        ConvolutionLayout layout(from != nullptr ? from->layout : to->layout);
+        layout.compactSpectra = false;
+
+        const size_t untrimmedLen = std::max(from != nullptr ? from->untrimmedLength : 0,
+                                             to != nullptr ? to->untrimmedLength : 0);
+
+        std::shared_ptr<ConvolutionKernel> kernel(new ConvolutionKernel(layout, irLen, delay,
+                                                                        std::max(untrimmedLen, delay + irLen)));
+        kernel->initStages();
+
+        for (size_t s = 0; s < kernel->numStages; ++s)
+        {
+            Stage& stage(kernel->stages[s]);
+            const Stage* const fromStage = from != nullptr && s < from->numStages ? &from->stages[s] : nullptr;
+            const Stage* const toStage = to != nullptr && s < to->numStages ? &to->stages[s] : nullptr;
+
+            stage.filterActive([fromStage, toStage](const uint32_t index) {
+                return (fromStage != nullptr && fromStage->isActive(index)) ||
+                       (toStage != nullptr && toStage->isActive(index));
+            });
+
+            for (size_t a = 0; a < stage.numActive; ++a)
+                stage.blend(stage.activeData[a], fromStage, toStage, amount);
+        }
+
+        return kernel;
+    }
+
+    // amount of partitions needed for an IR of `irLen` samples
+    static size_t countPartitions(const size_t irLen, const ConvolutionLayout& layout) noexcept
+    {
+        size_t blockSize = layout.headBlockSize;
+        size_t offset = 0;
+        size_t count = 0;
+
+        for (uint32_t s = 0; s < layout.maxStages && offset < irLen; ++s)
+        {
+            const size_t nextBlockSize = blockSize * layout.stageGrowthFactor;
+            const size_t stageEnd = s + 1 == layout.maxStages ? irLen : std::min(irLen, nextBlockSize * 2);
+
+            count += (stageEnd - offset + blockSize - 1) / blockSize;
+            offset = stageEnd;
+            blockSize = nextBlockSize;
+        }
+
+        return count;
+    }
+
+    const ConvolutionLayout& getLayout() const noexcept
+    {
+        return layout;
+    }
+
+    size_t getIRLength() const noexcept
+    {
+        return irLength;
+    }
+
+    size_t getDelay() const noexcept
+    {
+        return delay;
+    }
+
+    size_t getUntrimmedLength() const noexcept
+    {
+        return untrimmedLength;
+    }
+
+    size_t getNumPartitions() const noexcept
+    {
+        size_t count = 0;
+        for (size_t s = 0; s < numStages; ++s)
+            count += stages[s].numPartitions;
+        return count;
+    }
+
+    size_t getNumActivePartitions() const noexcept
+    {
+        size_t count = 0;
+        for (size_t s = 0; s < numStages; ++s)
+            count += stages[s].numActive;
+        return count;
+    }
+
+    size_t getNumStages() const noexcept
+    {
+        return numStages;
+    }
+
+    const Stage& getStage(const size_t index) const noexcept
+    {
+        return stages[index];
+    }
+
+    // for mixing into kernels made by `createBlend`, which are not shared
+    Stage& getStage(const size_t index) noexcept
+    {
+        return stages[index];
+    }
+
+private:
+    const ConvolutionLayout layout;
+    const size_t irLength;
+    const size_t delay;
+    const size_t untrimmedLength;
+    size_t numStages;
+    Stage stages[kMaxStages];
+
+    // keeps external spectra storage alive, if in use
+    std::shared_ptr<const void> storage;
+
+    ConvolutionKernel(const ConvolutionLayout& l, const size_t irLen, const size_t delay_, const size_t untrimmedLen)
+        : layout(l),
+          irLength(irLen),
+          delay(delay_),
+          untrimmedLength(untrimmedLen),
+          numStages(0) {}
+
+    // split the IR into stages according to the layout, with zeroed spectra
+    void initStages()
+    {
+        size_t blockSize = layout.headBlockSize;
+        size_t offset = 0;
+
+        for (; numStages < layout.maxStages; ++numStages)
+        {
+            const bool isLastStage = numStages + 1 == layout.maxStages;
+            const size_t nextBlockSize = blockSize * layout.stageGrowthFactor;
+            const size_t stageEnd = isLastStage ? irLength : std::min(irLength, nextBlockSize * 2);
+
+            stages[numStages].init(blockSize, offset, stageEnd - offset, layout.compactSpectra);
+
+            if (stageEnd == irLength)
+            {
+                ++numStages;
+                break;
+            }
+
+            offset = stageEnd;
+            blockSize = nextBlockSize;
+        }
+    }
+
+    friend class ConvolutionKernelDiskCache;
+
+    DISTRHO_DECLARE_NON_COPYABLE(ConvolutionKernel)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
@@ -0,0 +1,294 @@
+/*
+ * Convolution Kernel Cache
+ * Copyright (C) 2022-2023 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: ISC
+ */
+
+#pragma once
+
+#include "ConvolutionKernel.hpp"
+#include "ConvolutionLateTail.hpp"
+#include "ConvolutionTrimmer.hpp"
+#include "extra/Mutex.hpp"
+
+#include <sys/stat.h>
+#include <vector>
+
+#ifndef DISTRHO_OS_WASM
+# include <future>
+#endif
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// Process-wide cache of IR kernels, so that plugin instances loading the same file share the same spectra.
+//
+// Only weak references are kept, kernels are freed as soon as the last convolver using them goes away.
+// Kernels being made are tracked too, so instances loading the same file at once wait for the first one to finish.
+
+class ConvolutionKernelCache
+{
+public:
+    struct Key {
+        String filename;
+        int64_t modificationTime;
+        double sampleRate;
+        ConvolutionLayout layout;
+        ConvolutionTrimSettings trim;
+
+        Key()
+            : filename(),
+              modificationTime(0),
+              sampleRate(0.0),
+              layout(),
+              trim() {}
+
+        // returns false if the file does not exist
+        bool init(const char* const filename_, const double sampleRate_,
+                  const ConvolutionLayout& layout_, const ConvolutionTrimSettings& trim_)
+        {
+            struct stat st;
+            if (::stat(filename_, &st) != 0)
+                return false;
+
+            filename = filename_;
+            modificationTime = static_cast<int64_t>(st.st_mtime);
+            sampleRate = sampleRate_;
+            layout = layout_;
+            trim = trim_;
+            return true;
+        }
+
+        // same file contents and trimming, regardless of the sample rate and layout the kernels are made for
+        bool isSameSource(const Key& other) const noexcept
+        {
+            return modificationTime == other.modificationTime &&
+                   trim == other.trim &&
+                   filename == other.filename;
+        }
+
+        bool operator==(const Key& other) const noexcept
+        {
+            return modificationTime == other.modificationTime &&
+                   d_isEqual(sampleRate, other.sampleRate) &&
+                   layout == other.layout &&
+                   trim == other.trim &&
+                   filename == other.filename;
+        }
+    };
+
+    // decoded channels of an IR file at its own sample rate, limited to the trimmed region,
+    // with the decay of whatever a maximum trim length cut away.
+    // kept alive together with the kernels made from it, so they can be rebuilt for another sample rate
+    // without reading the file again.
+    struct Source {
+        double sampleRate;
+        size_t numFrames;
+        ConvolutionTrimmer::Region region;
+        uint numChannels;
+        std::vector<float> channels[4];
+        ConvolutionLateTailParameters lateTail;
+    };
+
+    // left to left and right to right, plus the cross-channel paths for true stereo IRs
+    struct Kernels {
+        std::shared_ptr<const ConvolutionKernel> left;
+        std::shared_ptr<const ConvolutionKernel> right;
+        std::shared_ptr<const ConvolutionKernel> leftToRight;
+        std::shared_ptr<const ConvolutionKernel> rightToLeft;
+        // null if the kernels came from the disk cache and nobody has the file decoded
+        std::shared_ptr<const Source> source;
+        // for the part of the IR cut away by the trim maximum length, if any
+        ConvolutionLateTailParameters lateTail;
+
+        bool isTrueStereo() const noexcept
+        {
+            return leftToRight != nullptr && rightToLeft != nullptr;
+        }
+    };
+
+    static ConvolutionKernelCache& getInstance()
+    {
+        static ConvolutionKernelCache cache;
+        return cache;
+    }
+
+    // returns false if the caller has to make the kernels, and then must call put() or cancel() with the same key.
+    // waits first if someone else is making them already.
+    bool get(const Key& key, Kernels& kernels)
+    {
+       #ifndef DISTRHO_OS_WASM
+        for (;;)
+        {
+            std::shared_future<void> pending;
+
+            {
+                const MutexLocker cml(mutex);
+
+                if (find(key, kernels))
+                    return true;
+
+                for (const Build& build : builds)
+                {
+                    if (build.key == key)
+                    {
+                        pending = build.finished;
+                        break;
+                    }
+                }
+
+                if (! pending.valid())
+                {
+                    builds.push_back(Build(key));
+                    return false;
+                }
+            }
+
+            // try again once done, or make them ourselves if that failed
+            pending.wait();
+        }
+       #else
+        const MutexLocker cml(mutex);
+        return find(key, kernels);
+       #endif
+    }
+
+    // the kernels for a key returned by get() could not be made
+    void cancel(const Key& key)
+    {
+       #ifndef DISTRHO_OS_WASM
+        const MutexLocker cml(mutex);
+        finishBuild(key);
+       #else
+        // unused
+        (void)key;
+       #endif
+    }
+
+    // decoded IR for the same file and trimming as `key`, from kernels made at any sample rate
+    std::shared_ptr<const Source> getSource(const Key& key)
+    {
+        const MutexLocker cml(mutex);
+
+        for (const Entry& entry : entries)
+        {
+            if (! entry.key.isSameSource(key))
+                continue;
+
+            if (const std::shared_ptr<const Source> source = entry.source.lock())
+                return source;
+        }
+
+        return nullptr;
+    }
+
+    void put(const Key& key, const Kernels& kernels)
+    {
+        const MutexLocker cml(mutex);
+
+        // drop entries no longer in use by anyone
+        for (std::vector<Entry>::iterator it = entries.begin(); it != entries.end();)
+        {
+            if (it->left.expired() || it->right.expired() || it->key == key)
+                it = entries.erase(it);
+            else
+                ++it;
+        }
+
+        Entry entry;
+        entry.key = key;
+        entry.left = kernels.left;
+        entry.right = kernels.right;
+        entry.leftToRight = kernels.leftToRight;
+        entry.rightToLeft = kernels.rightToLeft;
+        entry.source = kernels.source;
+        entry.lateTail = kernels.lateTail;
+        entry.trueStereo = kernels.isTrueStereo();
+        entries.push_back(entry);
+
+       #ifndef DISTRHO_OS_WASM
+        finishBuild(key);
+       #endif
+    }
+
+private:
+    struct Entry {
+        Key key;
+        std::weak_ptr<const ConvolutionKernel> left;
+        std::weak_ptr<const ConvolutionKernel> right;
+        std::weak_ptr<const ConvolutionKernel> leftToRight;
+        std::weak_ptr<const ConvolutionKernel> rightToLeft;
+        std::weak_ptr<const Source> source;
+        ConvolutionLateTailParameters lateTail;
+        bool trueStereo;
+    };
+
+   #ifndef DISTRHO_OS_WASM
+    struct Build {
+        Key key;
+        std::promise<void> promise;
+        std::shared_future<void> finished;
+
+        Build(const Key& key_)
+            : key(key_),
+              promise(),
+              finished(promise.get_future().share()) {}
+    };
+   #endif
+
+    Mutex mutex;
+    std::vector<Entry> entries;
+   #ifndef DISTRHO_OS_WASM
+    std::vector<Build> builds;
+   #endif
+
+    ConvolutionKernelCache() {}
+
+    // must be called with the mutex locked
+    bool find(const Key& key, Kernels& kernels)
+    {
+        for (std::vector<Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (!(it->key == key))
+                continue;
+
+            kernels.left = it->left.lock();
+            kernels.right = it->right.lock();
+            kernels.leftToRight = it->leftToRight.lock();
+            kernels.rightToLeft = it->rightToLeft.lock();
+            kernels.source = it->source.lock();
+            kernels.lateTail = it->lateTail;
+
+            if (kernels.left != nullptr && kernels.right != nullptr && kernels.isTrueStereo() == it->trueStereo)
+                return true;
+
+            entries.erase(it);
+            break;
+        }
+
+        kernels = Kernels();
+        return false;
+    }
+
+   #ifndef DISTRHO_OS_WASM
+    // wake up everyone waiting for the kernels of a key, must be called with the mutex locked
+    void finishBuild(const Key& key)
+    {
+        for (std::vector<Build>::iterator it = builds.begin(); it != builds.end(); ++it)
+        {
+            if (it->key == key)
+            {
+                it->promise.set_value();
+                builds.erase(it);
+                break;
+            }
+        }
+    }
+   #endif
+
+    DISTRHO_DECLARE_NON_COPYABLE(ConvolutionKernelCache)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
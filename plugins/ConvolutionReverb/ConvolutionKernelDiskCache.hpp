@@ -0,0 +1,769 @@
+/*
+ * Convolution Kernel Disk Cache
+ * Copyright (C) 2022-2023 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: ISC
+ */
+
+#pragma once
+
+#include "ConvolutionKernelCache.hpp"
+
+#ifdef DISTRHO_OS_WINDOWS
+# ifndef WIN32_LEAN_AND_MEAN
+#  define WIN32_LEAN_AND_MEAN
+# endif
+# include <winsock2.h>
+# include <windows.h>
+#else
+# include <dirent.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <sys/time.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// On-disk cache of already resampled, trimmed and partitioned IR kernels,
+// one file per IR + sample rate + layout + trim settings.
+//
+// Files are memory-mapped and the convolvers read the spectra straight from the mapping, no copies are made.
+// Mappings are fully paged in (and locked, if allowed) while loading, so no disk reads happen when processing.
+// The format is native-endian and versioned, any mismatch simply results in a cache miss.
+//
+// The cache is kept under kMaxTotalSize, least recently used files are removed after storing a new one.
+//
+// File layout, with every section aligned to 64 bytes:
+//   FileHeader, including the late tail parameters
+//   original IR filename
+//   KernelHeader + StageHeader[numStages], repeated for each kernel (1 for mono, 2 for stereo, 4 for true stereo)
+//   spectra data, real then imaginary parts of each stage followed by its active partition indices.
+//   spectra are floats, or bfloat16 values for compact layouts
+
+class ConvolutionKernelDiskCache
+{
+    static constexpr const uint32_t kVersion = 6;
+    static constexpr const uint32_t kMaxKernels = 4;
+    static constexpr const uint32_t kByteOrder = 0x01020304;
+    static constexpr const size_t kAlignment = 64;
+    static constexpr const uint64_t kMaxTotalSize = 1024ULL * 1024 * 1024;
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint32_t sampleSize;
+        uint32_t numKernels;
+        uint32_t headBlockSize;
+        uint32_t stageGrowthFactor;
+        uint32_t maxStages;
+        uint32_t filenameLength;
+        int64_t modificationTime;
+        double sampleRate;
+        uint64_t totalSize;
+        float onsetThreshold;
+        float tailFloor;
+        float fadeLength;
+        uint32_t compactSpectra;
+        float maxLength;
+        float tailOnset;
+        float tailDecayTimes[ConvolutionLateTailParameters::kNumBands];
+        float tailLevels[ConvolutionLateTailParameters::kNumBands];
+    };
+
+    struct KernelHeader {
+        uint64_t irLength;
+        uint64_t numStages;
+        uint64_t delay;
+        uint64_t untrimmedLength;
+    };
+
+    struct StageHeader {
+        uint64_t blockSize;
+        uint64_t irOffset;
+        uint64_t numPartitions;
+        uint64_t complexSize;
+        uint64_t numActive;
+        uint64_t dataOffset;
+    };
+
+    static_assert(sizeof(FileHeader) == 112, "unexpected padding");
+    static_assert(sizeof(KernelHeader) == 32, "unexpected padding");
+    static_assert(sizeof(StageHeader) == 48, "unexpected padding");
+
+public:
+    static bool load(const ConvolutionKernelCache::Key& key, ConvolutionKernelCache::Kernels& kernels)
+    {
+       #ifdef DISTRHO_OS_WASM
+        return false;
+       #else
+        const String filename(getCacheFilename(key));
+
+        if (filename.isEmpty())
+            return false;
+
+        std::shared_ptr<MappedFile> mapping(MappedFile::open(filename));
+
+        if (mapping == nullptr)
+            return false;
+
+        // mark as recently used, for eviction
+        touchFile(filename);
+
+        const uint8_t* const data = static_cast<const uint8_t*>(mapping->ptr);
+        const size_t size = mapping->size;
+
+        if (size < sizeof(FileHeader))
+            return false;
+
+        const FileHeader& header(*reinterpret_cast<const FileHeader*>(data));
+        const size_t keyFilenameLength = key.filename.length();
+
+        if (std::memcmp(header.magic, kMagic, sizeof(header.magic)) != 0 ||
+            header.version != kVersion ||
+            header.byteOrder != kByteOrder ||
+            header.sampleSize != sizeof(fftconvolver::Sample) ||
+            (header.numKernels != 1 && header.numKernels != 2 && header.numKernels != kMaxKernels) ||
+            header.headBlockSize != key.layout.headBlockSize ||
+            header.stageGrowthFactor != key.layout.stageGrowthFactor ||
+            header.maxStages != key.layout.maxStages ||
+            header.compactSpectra != (key.layout.compactSpectra ? 1U : 0U) ||
+            d_isNotEqual(header.onsetThreshold, key.trim.onsetThreshold) ||
+            d_isNotEqual(header.tailFloor, key.trim.tailFloor) ||
+            d_isNotEqual(header.fadeLength, key.trim.fadeLength) ||
+            d_isNotEqual(header.maxLength, key.trim.maxLength) ||
+            header.filenameLength != keyFilenameLength ||
+            header.modificationTime != key.modificationTime ||
+            d_isNotEqual(header.sampleRate, key.sampleRate) ||
+            header.totalSize != size ||
+            sizeof(FileHeader) + keyFilenameLength > size ||
+            std::memcmp(data + sizeof(FileHeader), key.filename.buffer(), keyFilenameLength) != 0)
+        {
+            d_stderr("ConvolutionKernelDiskCache: ignoring outdated or invalid cache file '%s'", filename.buffer());
+            return false;
+        }
+
+        std::shared_ptr<const ConvolutionKernel> loaded[kMaxKernels];
+        const size_t valueSize = getValueSize(key.layout);
+        size_t offset = align(sizeof(FileHeader) + keyFilenameLength);
+
+        for (uint32_t k = 0; k < header.numKernels; ++k)
+        {
+            if (offset + sizeof(KernelHeader) > size)
+                return false;
+
+            const KernelHeader& kernelHeader(*reinterpret_cast<const KernelHeader*>(data + offset));
+            offset += sizeof(KernelHeader);
+
+            if (kernelHeader.numStages == 0 || kernelHeader.numStages > ConvolutionKernel::kMaxStages)
+                return false;
+            if (offset + sizeof(StageHeader) * kernelHeader.numStages > size)
+                return false;
+
+            std::shared_ptr<ConvolutionKernel> kernel(new ConvolutionKernel(key.layout,
+                                                                            kernelHeader.irLength,
+                                                                            kernelHeader.delay,
+                                                                            kernelHeader.untrimmedLength));
+            kernel->storage = mapping;
+
+            for (uint64_t s = 0; s < kernelHeader.numStages; ++s, offset += sizeof(StageHeader))
+            {
+                const StageHeader& stageHeader(*reinterpret_cast<const StageHeader*>(data + offset));
+                const size_t numValues = stageHeader.numPartitions * stageHeader.complexSize;
+                const size_t valuesSize = align(numValues * valueSize);
+
+                if (stageHeader.blockSize == 0 ||
+                    stageHeader.complexSize != stageHeader.blockSize + 1 ||
+                    stageHeader.numActive > stageHeader.numPartitions ||
+                    stageHeader.dataOffset % kAlignment != 0 ||
+                    stageHeader.dataOffset + getStageDataSize(numValues, valueSize, stageHeader.numActive) > size)
+                    return false;
+
+                const uint32_t* const active = reinterpret_cast<const uint32_t*>(
+                    data + stageHeader.dataOffset + valuesSize * 2);
+
+                for (uint64_t a = 0; a < stageHeader.numActive; ++a)
+                {
+                    if (active[a] >= stageHeader.numPartitions || (a != 0 && active[a] <= active[a - 1]))
+                        return false;
+                }
+
+                ConvolutionKernel::Stage& stage(kernel->stages[s]);
+                stage.blockSize = stageHeader.blockSize;
+                stage.irOffset = stageHeader.irOffset;
+                stage.numPartitions = stageHeader.numPartitions;
+                stage.complexSize = stageHeader.complexSize;
+                stage.compact = key.layout.compactSpectra;
+
+                if (stage.compact)
+                {
+                    stage.reCompactData = reinterpret_cast<const ConvolutionKernel::CompactSample*>(
+                        data + stageHeader.dataOffset);
+                    stage.imCompactData = reinterpret_cast<const ConvolutionKernel::CompactSample*>(
+                        data + stageHeader.dataOffset + valuesSize);
+                }
+                else
+                {
+                    stage.reData = reinterpret_cast<const fftconvolver::Sample*>(data + stageHeader.dataOffset);
+                    stage.imData = reinterpret_cast<const fftconvolver::Sample*>(data + stageHeader.dataOffset + valuesSize);
+                }
+
+                stage.activeData = active;
+                stage.numActive = stageHeader.numActive;
+            }
+
+            kernel->numStages = kernelHeader.numStages;
+            loaded[k] = kernel;
+        }
+
+        // kernels are stored as left, right, left to right and right to left
+        kernels.left = loaded[0];
+        kernels.right = header.numKernels >= 2 ? loaded[1] : loaded[0];
+        kernels.leftToRight = loaded[2];
+        kernels.rightToLeft = loaded[3];
+
+        kernels.lateTail.onset = header.tailOnset;
+        for (uint b = 0; b < ConvolutionLateTailParameters::kNumBands; ++b)
+        {
+            kernels.lateTail.decayTimes[b] = header.tailDecayTimes[b];
+            kernels.lateTail.levels[b] = header.tailLevels[b];
+        }
+
+        return true;
+       #endif
+    }
+
+    static bool store(const ConvolutionKernelCache::Key& key, const ConvolutionKernelCache::Kernels& kernels)
+    {
+       #ifdef DISTRHO_OS_WASM
+        return false;
+       #else
+        DISTRHO_SAFE_ASSERT_RETURN(kernels.left != nullptr && kernels.right != nullptr, false);
+
+        const String filename(getCacheFilename(key));
+
+        if (filename.isEmpty())
+            return false;
+
+        const ConvolutionKernel* const kernelList[kMaxKernels] = {
+            kernels.left.get(), kernels.right.get(), kernels.leftToRight.get(), kernels.rightToLeft.get()
+        };
+        const uint32_t numKernels = kernels.isTrueStereo() ? kMaxKernels : kernels.left == kernels.right ? 1 : 2;
+        const size_t keyFilenameLength = key.filename.length();
+        const size_t valueSize = getValueSize(key.layout);
+
+        // calculate where everything goes
+        size_t offset = align(sizeof(FileHeader) + keyFilenameLength);
+
+        for (uint32_t k = 0; k < numKernels; ++k)
+            offset += sizeof(KernelHeader) + sizeof(StageHeader) * kernelList[k]->getNumStages();
+
+        offset = align(offset);
+
+        const size_t dataStart = offset;
+
+        for (uint32_t k = 0; k < numKernels; ++k)
+        {
+            for (size_t s = 0; s < kernelList[k]->getNumStages(); ++s)
+            {
+                const ConvolutionKernel::Stage& stage(kernelList[k]->getStage(s));
+                offset += getStageDataSize(stage.numPartitions * stage.complexSize, valueSize, stage.numActive);
+            }
+        }
+
+        FileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, kMagic, sizeof(header.magic));
+        header.version = kVersion;
+        header.byteOrder = kByteOrder;
+        header.sampleSize = sizeof(fftconvolver::Sample);
+        header.numKernels = numKernels;
+        header.headBlockSize = key.layout.headBlockSize;
+        header.stageGrowthFactor = key.layout.stageGrowthFactor;
+        header.maxStages = key.layout.maxStages;
+        header.compactSpectra = key.layout.compactSpectra ? 1 : 0;
+        header.onsetThreshold = key.trim.onsetThreshold;
+        header.tailFloor = key.trim.tailFloor;
+        header.fadeLength = key.trim.fadeLength;
+        header.maxLength = key.trim.maxLength;
+        header.tailOnset = kernels.lateTail.onset;
+        for (uint b = 0; b < ConvolutionLateTailParameters::kNumBands; ++b)
+        {
+            header.tailDecayTimes[b] = kernels.lateTail.decayTimes[b];
+            header.tailLevels[b] = kernels.lateTail.levels[b];
+        }
+        header.filenameLength = keyFilenameLength;
+        header.modificationTime = key.modificationTime;
+        header.sampleRate = key.sampleRate;
+        header.totalSize = offset;
+
+        // write to a temporary file first, so other instances never see a partial file.
+        // the name must be unique across processes and threads, so use both
+        static std::atomic<uint> tmpCounter(0);
+        char tmpSuffix[48];
+        std::snprintf(tmpSuffix, sizeof(tmpSuffix), ".%lu.%u.tmp",
+                      getProcessId(), static_cast<uint>(tmpCounter.fetch_add(1)));
+        const String tmpFilename(filename + tmpSuffix);
+
+        FILE* const fd = std::fopen(tmpFilename, "wb");
+        DISTRHO_SAFE_ASSERT_RETURN(fd != nullptr, false);
+
+        bool ok = std::fwrite(&header, sizeof(header), 1, fd) == 1
+               && std::fwrite(key.filename.buffer(), 1, keyFilenameLength, fd) == keyFilenameLength
+               && writePadding(fd, sizeof(header) + keyFilenameLength);
+
+        size_t dataOffset = dataStart;
+        size_t headersSize = 0;
+
+        for (uint32_t k = 0; ok && k < numKernels; ++k)
+        {
+            const KernelHeader kernelHeader = {
+                kernelList[k]->getIRLength(),
+                kernelList[k]->getNumStages(),
+                kernelList[k]->getDelay(),
+                kernelList[k]->getUntrimmedLength()
+            };
+            ok = std::fwrite(&kernelHeader, sizeof(kernelHeader), 1, fd) == 1;
+            headersSize += sizeof(kernelHeader);
+
+            for (size_t s = 0; ok && s < kernelList[k]->getNumStages(); ++s)
+            {
+                const ConvolutionKernel::Stage& stage(kernelList[k]->getStage(s));
+                const StageHeader stageHeader = {
+                    stage.blockSize,
+                    stage.irOffset,
+                    stage.numPartitions,
+                    stage.complexSize,
+                    stage.numActive,
+                    dataOffset
+                };
+                ok = std::fwrite(&stageHeader, sizeof(stageHeader), 1, fd) == 1;
+                headersSize += sizeof(stageHeader);
+                dataOffset += getStageDataSize(stage.numPartitions * stage.complexSize, valueSize, stage.numActive);
+            }
+        }
+
+        ok = ok && writePadding(fd, headersSize);
+
+        for (uint32_t k = 0; ok && k < numKernels; ++k)
+        {
+            for (size_t s = 0; ok && s < kernelList[k]->getNumStages(); ++s)
+            {
+                const ConvolutionKernel::Stage& stage(kernelList[k]->getStage(s));
+                const size_t numValues = stage.numPartitions * stage.complexSize;
+                const void* const re = stage.compact ? static_cast<const void*>(stage.reCompactData)
+                                                     : static_cast<const void*>(stage.reData);
+                const void* const im = stage.compact ? static_cast<const void*>(stage.imCompactData)
+                                                     : static_cast<const void*>(stage.imData);
+
+                ok = std::fwrite(re, valueSize, numValues, fd) == numValues
+                  && writePadding(fd, numValues * valueSize)
+                  && std::fwrite(im, valueSize, numValues, fd) == numValues
+                  && writePadding(fd, numValues * valueSize)
+                  && (stage.numActive == 0 ||
+                      std::fwrite(stage.activeData, sizeof(uint32_t), stage.numActive, fd) == stage.numActive)
+                  && writePadding(fd, stage.numActive * sizeof(uint32_t));
+            }
+        }
+
+        ok = std::fclose(fd) == 0 && ok;
+
+        if (ok)
+        {
+           #ifdef DISTRHO_OS_WINDOWS
+            std::remove(filename);
+           #endif
+            ok = std::rename(tmpFilename, filename) == 0;
+        }
+
+        if (! ok)
+        {
+            d_stderr("ConvolutionKernelDiskCache: failed to write cache file '%s'", filename.buffer());
+            std::remove(tmpFilename);
+            return false;
+        }
+
+        evict(filename);
+        return true;
+       #endif
+    }
+
+private:
+    static constexpr const char kMagic[8] = { 'O', 'K', 'I', 'R', 'K', 'R', 'N', '\0' };
+
+    static size_t align(const size_t size) noexcept
+    {
+        return (size + kAlignment - 1) & ~(kAlignment - 1);
+    }
+
+    static size_t getValueSize(const ConvolutionLayout& layout) noexcept
+    {
+        return layout.compactSpectra ? sizeof(ConvolutionKernel::CompactSample) : sizeof(fftconvolver::Sample);
+    }
+
+    // real and imaginary parts of `numValues` each, then `numActive` partition indices
+    static size_t getStageDataSize(const size_t numValues, const size_t valueSize, const size_t numActive) noexcept
+    {
+        return align(numValues * valueSize) * 2 + align(numActive * sizeof(uint32_t));
+    }
+
+    static bool writePadding(FILE* const fd, const size_t writtenSize)
+    {
+        static const uint8_t zeros[kAlignment] = {};
+        const size_t padding = align(writtenSize) - writtenSize;
+        return padding == 0 || std::fwrite(zeros, 1, padding, fd) == padding;
+    }
+
+   #ifndef DISTRHO_OS_WASM
+    struct MappedFile {
+        const void* ptr;
+        size_t size;
+       #ifdef DISTRHO_OS_WINDOWS
+        HANDLE file;
+        HANDLE mapping;
+       #endif
+
+        static MappedFile* open(const char* const filename)
+        {
+           #ifdef DISTRHO_OS_WINDOWS
+            const HANDLE file = ::CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                return nullptr;
+
+            LARGE_INTEGER size;
+            if (! ::GetFileSizeEx(file, &size) || size.QuadPart == 0)
+            {
+                ::CloseHandle(file);
+                return nullptr;
+            }
+
+            const HANDLE mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping == nullptr)
+            {
+                ::CloseHandle(file);
+                return nullptr;
+            }
+
+            const void* const ptr = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (ptr == nullptr)
+            {
+                ::CloseHandle(mapping);
+                ::CloseHandle(file);
+                return nullptr;
+            }
+
+            MappedFile* const mf = new MappedFile;
+            mf->ptr = ptr;
+            mf->size = static_cast<size_t>(size.QuadPart);
+            mf->file = file;
+            mf->mapping = mapping;
+            mf->prefault();
+            return mf;
+           #else
+            const int fd = ::open(filename, O_RDONLY);
+            if (fd < 0)
+                return nullptr;
+
+            struct stat st;
+            if (::fstat(fd, &st) != 0 || st.st_size <= 0)
+            {
+                ::close(fd);
+                return nullptr;
+            }
+
+            int flags = MAP_SHARED;
+           #ifdef MAP_POPULATE
+            flags |= MAP_POPULATE;
+           #endif
+
+            void* const ptr = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, flags, fd, 0);
+            ::close(fd);
+
+            if (ptr == MAP_FAILED)
+                return nullptr;
+
+            // failing is fine, usually means RLIMIT_MEMLOCK is too low. pages are still touched below
+            ::mlock(ptr, static_cast<size_t>(st.st_size));
+
+            MappedFile* const mf = new MappedFile;
+            mf->ptr = ptr;
+            mf->size = static_cast<size_t>(st.st_size);
+            mf->prefault();
+            return mf;
+           #endif
+        }
+
+        // read one byte of every page, so the page faults happen here instead of in the convolvers
+        void prefault() const noexcept
+        {
+            // smallest page size in use, touching more often than needed is harmless
+            static constexpr const size_t kPageSize = 4096;
+
+            const volatile uint8_t* const bytes = static_cast<const volatile uint8_t*>(ptr);
+            uint8_t sum = 0;
+
+            for (size_t i = 0; i < size; i += kPageSize)
+                sum ^= bytes[i];
+
+            (void)sum;
+        }
+
+        ~MappedFile()
+        {
+           #ifdef DISTRHO_OS_WINDOWS
+            ::UnmapViewOfFile(ptr);
+            ::CloseHandle(mapping);
+            ::CloseHandle(file);
+           #else
+            ::munmap(const_cast<void*>(ptr), size);
+           #endif
+        }
+    };
+   #endif
+
+    static unsigned long getProcessId() noexcept
+    {
+       #ifdef DISTRHO_OS_WINDOWS
+        return ::GetCurrentProcessId();
+       #else
+        return static_cast<unsigned long>(::getpid());
+       #endif
+    }
+
+    static void touchFile(const char* const filename)
+    {
+       #ifdef DISTRHO_OS_WINDOWS
+        const HANDLE file = ::CreateFileA(filename, FILE_WRITE_ATTRIBUTES,
+                                          FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, nullptr,
+                                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+
+        SYSTEMTIME now;
+        FILETIME time;
+        ::GetSystemTime(&now);
+        ::SystemTimeToFileTime(&now, &time);
+        ::SetFileTime(file, nullptr, nullptr, &time);
+        ::CloseHandle(file);
+       #else
+        ::utimes(filename, nullptr);
+       #endif
+    }
+
+    struct CacheFile {
+        String filename;
+        uint64_t size;
+        int64_t lastUsed;
+    };
+
+    // cache files in `dir`, with leftover temporary files older than an hour also included as if they were
+    static std::vector<CacheFile> listCacheFiles(const String& dir)
+    {
+        std::vector<CacheFile> files;
+        const int64_t tmpExpiry = static_cast<int64_t>(std::time(nullptr)) - 3600;
+
+        const auto isCacheFile = [](const char* const name, const int64_t lastUsed, const int64_t expiry)
+        {
+            const size_t len = std::strlen(name);
+            if (len > 5 && std::strcmp(name + len - 5, ".okir") == 0)
+                return true;
+            return len > 4 && std::strcmp(name + len - 4, ".tmp") == 0 && lastUsed < expiry;
+        };
+
+       #ifdef DISTRHO_OS_WINDOWS
+        WIN32_FIND_DATAA data;
+        const HANDLE find = ::FindFirstFileA(dir + DISTRHO_OS_SEP_STR "*", &data);
+
+        if (find == INVALID_HANDLE_VALUE)
+            return files;
+
+        do {
+            if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                continue;
+
+            // FILETIME counts 100ns intervals since 1601
+            const int64_t lastUsed = static_cast<int64_t>(((static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32)
+                                                           | data.ftLastWriteTime.dwLowDateTime) / 10000000ULL)
+                                   - 11644473600LL;
+
+            if (! isCacheFile(data.cFileName, lastUsed, tmpExpiry))
+                continue;
+
+            const CacheFile file = {
+                dir + DISTRHO_OS_SEP_STR + data.cFileName,
+                (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow,
+                lastUsed
+            };
+            files.push_back(file);
+        } while (::FindNextFileA(find, &data));
+
+        ::FindClose(find);
+       #else
+        DIR* const d = ::opendir(dir);
+
+        if (d == nullptr)
+            return files;
+
+        while (const struct dirent* const entry = ::readdir(d))
+        {
+            const String filename(dir + DISTRHO_OS_SEP_STR + entry->d_name);
+            struct stat st;
+
+            if (::stat(filename, &st) != 0 || ! S_ISREG(st.st_mode))
+                continue;
+            if (! isCacheFile(entry->d_name, static_cast<int64_t>(st.st_mtime), tmpExpiry))
+                continue;
+
+            const CacheFile file = { filename, static_cast<uint64_t>(st.st_size), static_cast<int64_t>(st.st_mtime) };
+            files.push_back(file);
+        }
+
+        ::closedir(d);
+       #endif
+
+        return files;
+    }
+
+    // remove least recently used files until the cache fits in kMaxTotalSize, never removing `keep`.
+    // files still mapped by other instances stay valid until unmapped, or cannot be removed at all on Windows
+    static void evict(const String& keep)
+    {
+        const String dir(getCacheDirectory());
+
+        if (dir.isEmpty())
+            return;
+
+        std::vector<CacheFile> files(listCacheFiles(dir));
+        uint64_t totalSize = 0;
+
+        for (const CacheFile& file : files)
+            totalSize += file.size;
+
+        if (totalSize <= kMaxTotalSize)
+            return;
+
+        std::sort(files.begin(), files.end(), [](const CacheFile& a, const CacheFile& b) {
+            return a.lastUsed < b.lastUsed;
+        });
+
+        for (const CacheFile& file : files)
+        {
+            if (totalSize <= kMaxTotalSize)
+                break;
+            if (file.filename == keep)
+                continue;
+
+            if (std::remove(file.filename) == 0)
+                totalSize -= file.size;
+        }
+    }
+
+    static bool makeDirectory(const String& path)
+    {
+       #ifdef DISTRHO_OS_WINDOWS
+        return ::CreateDirectoryA(path, nullptr) || ::GetLastError() == ERROR_ALREADY_EXISTS;
+       #else
+        return ::mkdir(path, 0755) == 0 || errno == EEXIST;
+       #endif
+    }
+
+public:
+    // directory holding the cache files, created if needed, empty if not available
+    static String getCacheDirectory()
+    {
+        String dir;
+
+       #if defined(DISTRHO_OS_WINDOWS)
+        if (const char* const localAppData = std::getenv("LOCALAPPDATA"))
+            dir = localAppData;
+       #elif defined(DISTRHO_OS_MAC)
+        if (const char* const home = std::getenv("HOME"))
+        {
+            dir = home;
+            dir += "/Library/Caches";
+        }
+       #else
+        if (const char* const xdgCache = std::getenv("XDG_CACHE_HOME"))
+        {
+            dir = xdgCache;
+        }
+        else if (const char* const home = std::getenv("HOME"))
+        {
+            dir = home;
+            dir += "/.cache";
+        }
+       #endif
+
+        if (dir.isEmpty() || ! makeDirectory(dir))
+            return String();
+
+        static const char* const subdirs[] = { "DISTRHO", "OneKnob", "ir-kernels" };
+
+        for (uint i = 0; i < sizeof(subdirs) / sizeof(subdirs[0]); ++i)
+        {
+            dir += DISTRHO_OS_SEP_STR;
+            dir += subdirs[i];
+
+            if (! makeDirectory(dir))
+                return String();
+        }
+
+        return dir;
+    }
+
+private:
+    static String getCacheFilename(const ConvolutionKernelCache::Key& key)
+    {
+        const String dir(getCacheDirectory());
+
+        if (dir.isEmpty())
+            return String();
+
+        // FNV-1a hash of everything that makes up the key
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        const auto hashBytes = [&hash](const void* const ptr, const size_t size)
+        {
+            const uint8_t* const bytes = static_cast<const uint8_t*>(ptr);
+            for (size_t i = 0; i < size; ++i)
+            {
+                hash ^= bytes[i];
+                hash *= 0x100000001b3ULL;
+            }
+        };
+
+        hashBytes(key.filename.buffer(), key.filename.length());
+        hashBytes(&key.modificationTime, sizeof(key.modificationTime));
+        hashBytes(&key.sampleRate, sizeof(key.sampleRate));
+        hashBytes(&key.layout.headBlockSize, sizeof(key.layout.headBlockSize));
+        hashBytes(&key.layout.stageGrowthFactor, sizeof(key.layout.stageGrowthFactor));
+        hashBytes(&key.layout.maxStages, sizeof(key.layout.maxStages));
+        hashBytes(&key.layout.compactSpectra, sizeof(key.layout.compactSpectra));
+        hashBytes(&key.trim.onsetThreshold, sizeof(key.trim.onsetThreshold));
+        hashBytes(&key.trim.tailFloor, sizeof(key.trim.tailFloor));
+        hashBytes(&key.trim.fadeLength, sizeof(key.trim.fadeLength));
+        hashBytes(&key.trim.maxLength, sizeof(key.trim.maxLength));
+
+        char name[32];
+        std::snprintf(name, sizeof(name), DISTRHO_OS_SEP_STR "%016llx.okir", static_cast<unsigned long long>(hash));
+
+        return dir + name;
+    }
+
+    DISTRHO_DECLARE_NON_COPYABLE(ConvolutionKernelDiskCache)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
@@ -0,0 +1,407 @@
+/*
+ * Convolution Kernel Loader
+ * Copyright (C) 2022-2023 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: ISC
+ */
+
+#pragma once
+
+#ifndef DISTRHO_OS_WASM
+# include "Semaphore.hpp"
+# include "extra/Thread.hpp"
+#endif
+
+#include "extra/Mutex.hpp"
+#include "extra/ScopedPointer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// Process-wide pool of normal priority threads for loading IR files, shared by all plugin instances.
+//
+// Unlike the ConvolutionWorkerPool there are no deadlines here, queued jobs are picked by priority instead,
+// which is asked from the job itself every time so it can change while the job waits in the queue.
+// Jobs of equal priority run in submission order.
+//
+// Realtime threads cannot submit jobs, but can ask the loader to poll a client, which then submits them instead.
+
+class ConvolutionKernelLoader
+{
+    static constexpr const uint kMaxThreads = 16;
+
+    enum JobState {
+        kJobIdle,
+        kJobQueued,
+        kJobRunning,
+        kJobDone
+    };
+
+public:
+    class Job
+    {
+    public:
+        // jobs created with `autoDelete` belong to the loader once submitted,
+        // they are deleted after running and cannot be waited on
+        Job(const bool autoDelete_ = false)
+            : autoDelete(autoDelete_),
+              state(kJobIdle),
+              sequence(0)
+             #ifndef DISTRHO_OS_WASM
+            , semFinished(0)
+             #endif
+        {}
+
+        virtual ~Job() {}
+
+    protected:
+        virtual void runJob() = 0;
+
+        // higher values run first
+        virtual int getPriority() const
+        {
+            return 0;
+        }
+
+    private:
+        friend class ConvolutionKernelLoader;
+        const bool autoDelete;
+        std::atomic<int> state;
+        uint64_t sequence;
+       #ifndef DISTRHO_OS_WASM
+        Semaphore semFinished;
+       #endif
+
+        DISTRHO_DECLARE_NON_COPYABLE(Job)
+    };
+
+    class Client
+    {
+    public:
+        Client()
+            : pollRequested(false) {}
+
+        virtual ~Client() {}
+
+    protected:
+        // called from a loader thread after requestPoll(), never concurrently
+        virtual void poll() = 0;
+
+    private:
+        friend class ConvolutionKernelLoader;
+        std::atomic<bool> pollRequested;
+
+        DISTRHO_DECLARE_NON_COPYABLE(Client)
+    };
+
+    // keeps the process-wide loader alive while in use
+    struct SharedInstance {
+        SharedInstance()
+            : loader(acquire()) {}
+
+        ~SharedInstance()
+        {
+            release();
+        }
+
+        ConvolutionKernelLoader* operator->() const noexcept
+        {
+            return loader;
+        }
+
+        ConvolutionKernelLoader* const loader;
+
+        DISTRHO_DECLARE_NON_COPYABLE(SharedInstance)
+    };
+
+    static int64_t getTimeMs() noexcept
+    {
+        return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    void submitJob(Job* const job)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(job->state.load() == kJobIdle,);
+
+       #ifndef DISTRHO_OS_WASM
+        {
+            const MutexLocker cml(mutex);
+            job->sequence = nextSequence++;
+            job->state.store(kJobQueued);
+            queue.push_back(job);
+        }
+
+        semWorkAvailable.post();
+       #else
+        // no threads available, load synchronously
+        runAndFinish(job);
+       #endif
+    }
+
+    // clients must be added before requesting polls, and removed before being deleted
+    void addClient(Client* const client)
+    {
+       #ifndef DISTRHO_OS_WASM
+        const MutexLocker cml(clientsMutex);
+        clients.push_back(client);
+       #else
+        // unused
+        (void)client;
+       #endif
+    }
+
+    // waits for any poll of the client in progress
+    void removeClient(Client* const client)
+    {
+       #ifndef DISTRHO_OS_WASM
+        const MutexLocker cml(clientsMutex);
+
+        for (std::vector<Client*>::iterator it = clients.begin(); it != clients.end(); ++it)
+        {
+            if (*it == client)
+            {
+                clients.erase(it);
+                break;
+            }
+        }
+       #else
+        // unused
+        (void)client;
+       #endif
+    }
+
+    // have a loader thread poll the client soon, lock-free and safe to call from realtime threads
+    void requestPoll(Client* const client) noexcept
+    {
+       #ifndef DISTRHO_OS_WASM
+        client->pollRequested.store(true);
+        semWorkAvailable.post();
+       #else
+        // no threads available, poll synchronously
+        client->poll();
+       #endif
+    }
+
+    // wait for a previously submitted job to finish, running it in the calling thread if not started yet
+    void waitForJob(Job* const job)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(! job->autoDelete,);
+
+       #ifndef DISTRHO_OS_WASM
+        int expected = kJobQueued;
+
+        if (job->state.compare_exchange_strong(expected, kJobRunning))
+        {
+            removeFromQueue(job);
+            job->runJob();
+            job->state.store(kJobIdle);
+            return;
+        }
+
+        if (expected == kJobIdle)
+            return;
+
+        job->semFinished.wait();
+        job->state.store(kJobIdle);
+       #else
+        // unused
+        (void)job;
+       #endif
+    }
+
+private:
+   #ifndef DISTRHO_OS_WASM
+    struct Worker : Thread {
+        ConvolutionKernelLoader& loader;
+
+        Worker(ConvolutionKernelLoader& l)
+            : Thread("ConvolutionKernelLoader"),
+              loader(l) {}
+
+        void run() override
+        {
+            while (!shouldThreadExit())
+            {
+                loader.semWorkAvailable.wait();
+
+                if (shouldThreadExit())
+                    break;
+
+                loader.pollClients();
+
+                while (Job* const job = loader.takeJob())
+                    loader.runAndFinish(job);
+            }
+        }
+
+        DISTRHO_DECLARE_NON_COPYABLE(Worker)
+    };
+
+    Mutex mutex;
+    std::vector<Job*> queue;
+    Mutex clientsMutex;
+    std::vector<Client*> clients;
+    uint64_t nextSequence;
+    ScopedPointer<Worker> workers[kMaxThreads];
+    uint numWorkers;
+    Semaphore semWorkAvailable;
+
+    ConvolutionKernelLoader()
+        : nextSequence(0),
+          numWorkers(std::max(1U, std::min(kMaxThreads, std::thread::hardware_concurrency()))),
+          semWorkAvailable(0)
+    {
+        for (uint w = 0; w < numWorkers; ++w)
+        {
+            workers[w] = new Worker(*this);
+            workers[w]->startThread(false);
+        }
+    }
+
+    ~ConvolutionKernelLoader()
+    {
+        for (uint w = 0; w < numWorkers; ++w)
+            workers[w]->signalThreadShouldExit();
+
+        for (uint w = 0; w < numWorkers; ++w)
+            semWorkAvailable.post();
+
+        // let running loads finish, they are not safe to interrupt
+        for (uint w = 0; w < numWorkers; ++w)
+            workers[w]->stopThread(-1);
+
+        for (Job* job : queue)
+        {
+            if (job->autoDelete)
+                delete job;
+            else
+                job->state.store(kJobIdle);
+        }
+    }
+
+    Job* takeJob()
+    {
+        const MutexLocker cml(mutex);
+
+        while (! queue.empty())
+        {
+            size_t best = 0;
+            int bestPriority = queue[0]->getPriority();
+
+            for (size_t i = 1; i < queue.size(); ++i)
+            {
+                const int priority = queue[i]->getPriority();
+
+                if (priority > bestPriority || (priority == bestPriority && queue[i]->sequence < queue[best]->sequence))
+                {
+                    best = i;
+                    bestPriority = priority;
+                }
+            }
+
+            Job* const job = queue[best];
+            queue.erase(queue.begin() + best);
+
+            // the job might have been taken over by its owner in the mean time
+            int expected = kJobQueued;
+            if (job->state.compare_exchange_strong(expected, kJobRunning))
+                return job;
+        }
+
+        return nullptr;
+    }
+
+    void pollClients()
+    {
+        const MutexLocker cml(clientsMutex);
+
+        for (Client* const client : clients)
+        {
+            if (client->pollRequested.exchange(false))
+                client->poll();
+        }
+    }
+
+    void removeFromQueue(Job* const job)
+    {
+        const MutexLocker cml(mutex);
+
+        for (std::vector<Job*>::iterator it = queue.begin(); it != queue.end(); ++it)
+        {
+            if (*it == job)
+            {
+                queue.erase(it);
+                break;
+            }
+        }
+    }
+   #else
+    ConvolutionKernelLoader() {}
+   #endif
+
+    void runAndFinish(Job* const job)
+    {
+        job->runJob();
+
+        if (job->autoDelete)
+        {
+            delete job;
+            return;
+        }
+
+       #ifndef DISTRHO_OS_WASM
+        job->state.store(kJobDone);
+        job->semFinished.post();
+       #endif
+    }
+
+    static Mutex& getSharedMutex()
+    {
+        static Mutex mutex;
+        return mutex;
+    }
+
+    static ConvolutionKernelLoader*& getSharedLoader()
+    {
+        static ConvolutionKernelLoader* loader = nullptr;
+        return loader;
+    }
+
+    static uint& getSharedCount()
+    {
+        static uint count = 0;
+        return count;
+    }
+
+    static ConvolutionKernelLoader* acquire()
+    {
+        const MutexLocker cml(getSharedMutex());
+
+        if (getSharedCount()++ == 0)
+            getSharedLoader() = new ConvolutionKernelLoader();
+
+        return getSharedLoader();
+    }
+
+    static void release()
+    {
+        const MutexLocker cml(getSharedMutex());
+
+        if (--getSharedCount() == 0)
+        {
+            delete getSharedLoader();
+            getSharedLoader() = nullptr;
+        }
+    }
+
+    DISTRHO_DECLARE_NON_COPYABLE(ConvolutionKernelLoader)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
@@ -0,0 +1,540 @@
+/*
+ * Convolution Kernel Set
+ * Copyright (C) 2022-2023 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: ISC
+ */
+
+#pragma once
+
+#ifndef DISTRHO_OS_WASM
+# include "Semaphore.hpp"
+# include "extra/Thread.hpp"
+#endif
+
+#include "extra/Mutex.hpp"
+
+#include "ConvolutionKernelCache.hpp"
+#include "ConvolutionLateTail.hpp"
+#include "MultiStageThreadedConvolver.hpp"
+
+#include <atomic>
+#include <vector>
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// Everything needed to convolve a stereo signal with one IR file, or a morph between two of them.
+// A set without convolvers is valid and means "no IR loaded".
+
+struct ConvolutionKernelSet {
+    // stereo convolver, with either only the L/R kernels set or all 4 for true stereo IRs
+    ScopedPointer<MultiStageThreadedConvolver> convolver;
+
+    // optional stand-in for the part of the IR the convolver does not have, added to its output
+    ScopedPointer<ConvolutionLateTail> lateTail;
+
+    // decoded IR the kernels were made from, kept for rebuilding them on sample rate changes
+    std::shared_ptr<const ConvolutionKernelCache::Source> source;
+
+    // same for the IR being morphed into, if any
+    std::shared_ptr<const ConvolutionKernelCache::Source> morphSource;
+
+    // used for linking retired sets while they wait to be deleted
+    ConvolutionKernelSet* nextRetired = nullptr;
+
+    bool isEmpty() const noexcept
+    {
+        return convolver == nullptr;
+    }
+
+    uint32_t getLatency() const noexcept
+    {
+        return latency;
+    }
+
+    // with a latency, the convolver only ever runs on whole blocks of that many samples.
+    // matched to the head block size this is the cheapest way to run it, at the cost of delaying the output.
+    // must be called before publishing the set.
+    void setLatency(const uint32_t newLatency)
+    {
+        latency = newLatency;
+        latencyPosition = 0;
+
+        for (uint c = 0; c < 4; ++c)
+            latencyBuffers[c].assign(newLatency, 0.f);
+    }
+
+    // shorten the IR to a `ratio` of its full length, processing only what is left of it.
+    // with a late tail only the tail decay gets shorter, the convolved part is short already.
+    void setLength(const float ratio)
+    {
+        if (d_isEqual(lengthRatio, ratio))
+            return;
+
+        lengthRatio = ratio;
+
+        if (lateTail != nullptr)
+            lateTail->setLength(ratio);
+        else
+            convolver->setLength(static_cast<size_t>(ratio * convolver->getLength() + 0.5f));
+    }
+
+    // morph amount from the 1st IR into the 2nd one, does nothing unless the convolver was set up for morphing
+    void setMorph(const float amount) noexcept
+    {
+        convolver->setMorph(amount);
+    }
+
+    // delay the input by `samples`, up to the maximum the convolver was initialized with
+    void setPreDelay(const uint32_t samples)
+    {
+        if (preDelay == samples)
+            return;
+
+        preDelay = samples;
+        convolver->setPreDelay(samples);
+
+        if (lateTail != nullptr)
+            lateTail->setPreDelay(samples);
+    }
+
+    void process(const float* const inL, const float* const inR, float* const outL, float* const outR,
+                 const uint32_t frames)
+    {
+        if (latency == 0)
+        {
+            const float* const ins[2] = { inL, inR };
+            float* const outs[2] = { outL, outR };
+            convolver->process(ins, outs, frames);
+
+            if (lateTail != nullptr)
+                lateTail->process(ins, outs, frames);
+            return;
+        }
+
+        float* const blockInL = latencyBuffers[0].data();
+        float* const blockInR = latencyBuffers[1].data();
+        float* const blockOutL = latencyBuffers[2].data();
+        float* const blockOutR = latencyBuffers[3].data();
+
+        for (uint32_t offset = 0, todo; offset < frames; offset += todo)
+        {
+            todo = std::min(frames - offset, latency - latencyPosition);
+
+            std::memcpy(blockInL + latencyPosition, inL + offset, sizeof(float) * todo);
+            std::memcpy(blockInR + latencyPosition, inR + offset, sizeof(float) * todo);
+            std::memcpy(outL + offset, blockOutL + latencyPosition, sizeof(float) * todo);
+            std::memcpy(outR + offset, blockOutR + latencyPosition, sizeof(float) * todo);
+
+            latencyPosition += todo;
+
+            if (latencyPosition == latency)
+            {
+                latencyPosition = 0;
+
+                const float* const ins[2] = { blockInL, blockInR };
+                float* const outs[2] = { blockOutL, blockOutR };
+                convolver->process(ins, outs, latency);
+
+                if (lateTail != nullptr)
+                    lateTail->process(ins, outs, latency);
+            }
+        }
+    }
+
+private:
+    uint32_t latency = 0;
+    uint32_t latencyPosition = 0;
+    float lengthRatio = 1.f;
+    uint32_t preDelay = 0;
+
+    // block input and output, for left and right
+    std::vector<float> latencyBuffers[4];
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// Process-wide low priority thread for deleting kernel sets no longer in use, shared by all plugin instances.
+
+#ifndef DISTRHO_OS_WASM
+class ConvolutionKernelReclaimer : private Thread
+#else
+class ConvolutionKernelReclaimer
+#endif
+{
+public:
+    // keeps the process-wide reclaimer alive while in use
+    struct SharedInstance {
+        SharedInstance()
+            : reclaimer(acquire()) {}
+
+        ~SharedInstance()
+        {
+            release();
+        }
+
+        ConvolutionKernelReclaimer* operator->() const noexcept
+        {
+            return reclaimer;
+        }
+
+        ConvolutionKernelReclaimer* const reclaimer;
+
+        DISTRHO_DECLARE_NON_COPYABLE(SharedInstance)
+    };
+
+    // takes ownership of the set, lock-free so it can be called from the audio thread
+    void retire(ConvolutionKernelSet* const set) noexcept
+    {
+        ConvolutionKernelSet* head = retiredSets.load();
+        do {
+            set->nextRetired = head;
+        } while (! retiredSets.compare_exchange_weak(head, set));
+
+       #ifndef DISTRHO_OS_WASM
+        semReclaim.post();
+       #endif
+    }
+
+    // delete all sets retired so far, including any the reclaimer thread is busy with, before returning
+    void flush()
+    {
+        const MutexLocker cml(mutex);
+
+        ConvolutionKernelSet* set = retiredSets.exchange(nullptr);
+
+        while (set != nullptr)
+        {
+            ConvolutionKernelSet* const next = set->nextRetired;
+            delete set;
+            set = next;
+        }
+    }
+
+private:
+    std::atomic<ConvolutionKernelSet*> retiredSets;
+    Mutex mutex;
+   #ifndef DISTRHO_OS_WASM
+    Semaphore semReclaim;
+   #endif
+
+    ConvolutionKernelReclaimer()
+       #ifndef DISTRHO_OS_WASM
+        : Thread("ConvolutionKernelReclaimer"),
+          retiredSets(nullptr)
+       #else
+        : retiredSets(nullptr)
+       #endif
+    {
+       #ifndef DISTRHO_OS_WASM
+        startThread(false);
+       #endif
+    }
+
+    ~ConvolutionKernelReclaimer()
+    {
+       #ifndef DISTRHO_OS_WASM
+        signalThreadShouldExit();
+        semReclaim.post();
+        stopThread(5000);
+       #endif
+
+        flush();
+    }
+
+   #ifndef DISTRHO_OS_WASM
+    void run() override
+    {
+        while (!shouldThreadExit())
+        {
+            semReclaim.wait();
+            flush();
+        }
+    }
+   #endif
+
+    static Mutex& getSharedMutex()
+    {
+        static Mutex mutex;
+        return mutex;
+    }
+
+    static ConvolutionKernelReclaimer*& getSharedReclaimer()
+    {
+        static ConvolutionKernelReclaimer* reclaimer = nullptr;
+        return reclaimer;
+    }
+
+    static uint& getSharedCount()
+    {
+        static uint count = 0;
+        return count;
+    }
+
+    static ConvolutionKernelReclaimer* acquire()
+    {
+        const MutexLocker cml(getSharedMutex());
+
+        if (getSharedCount()++ == 0)
+            getSharedReclaimer() = new ConvolutionKernelReclaimer();
+
+        return getSharedReclaimer();
+    }
+
+    static void release()
+    {
+        const MutexLocker cml(getSharedMutex());
+
+        if (--getSharedCount() == 0)
+        {
+            delete getSharedReclaimer();
+            getSharedReclaimer() = nullptr;
+        }
+    }
+
+    DISTRHO_DECLARE_NON_COPYABLE(ConvolutionKernelReclaimer)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// Lock-free handover of kernel sets from a non-realtime thread to the audio thread.
+//
+// New sets are published through an atomic pointer swap, the audio thread picks them up on its next block and
+// crossfades from the old set into the new one over a fixed amount of time.
+// A set published while a crossfade is still running waits for it to finish, only the latest one is kept.
+// Sets that are no longer in use are handed over to the shared reclaimer for deletion.
+
+class ConvolutionKernelSwapper
+{
+public:
+    // crossfade duration in ms
+    static constexpr const double kCrossfadeTime = 50.0;
+
+    ConvolutionKernelSwapper()
+        : reclaimer(),
+          pendingSet(nullptr),
+          activeSet(nullptr),
+          fadingSet(nullptr),
+         #ifndef DISTRHO_OS_WASM
+          stats(nullptr),
+         #endif
+          crossfadeFrames(1),
+          lengthRatio(1.f),
+          morph(0.f),
+          preDelay(0),
+          crossfadeLength(0),
+          crossfadePosition(0),
+          bufferSize(0),
+          fadingBufL(nullptr),
+          fadingBufR(nullptr) {}
+
+    ~ConvolutionKernelSwapper()
+    {
+        delete pendingSet.exchange(nullptr);
+        delete activeSet;
+        delete fadingSet;
+
+        // sets retired by us might still refer to things owned by the plugin instance, like the stats
+        reclaimer->flush();
+
+        delete[] fadingBufL;
+        delete[] fadingBufR;
+    }
+
+    // ----------------------------------------------------------------------------------------------------------------
+    // non-realtime calls
+
+    // must not be called while processing
+    void setSampleRate(const double sampleRate) noexcept
+    {
+        crossfadeFrames = std::max(1U, static_cast<uint32_t>(kCrossfadeTime * 0.001 * sampleRate + 0.5));
+    }
+
+    // must not be called while processing
+    void setBufferSize(const uint32_t newBufferSize)
+    {
+        delete[] fadingBufL;
+        delete[] fadingBufR;
+
+        bufferSize = newBufferSize;
+
+        if (newBufferSize != 0)
+        {
+            fadingBufL = new float[newBufferSize];
+            fadingBufR = new float[newBufferSize];
+        }
+        else
+        {
+            fadingBufL = fadingBufR = nullptr;
+        }
+    }
+
+    // takes ownership of the set, passing null unloads the current one
+    void publish(ConvolutionKernelSet* set)
+    {
+        if (set == nullptr)
+            set = new ConvolutionKernelSet();
+
+        // if the audio thread did not pick up the previous set yet it never will, safe to delete here
+        delete pendingSet.exchange(set);
+
+       #ifdef DISTRHO_OS_WASM
+        reclaimer->flush();
+       #endif
+    }
+
+   #ifndef DISTRHO_OS_WASM
+    // record background job timing of current and future sets into `stats`, which must outlive this swapper.
+    // must not be called while processing.
+    void setStats(ConvolutionStats* const newStats) noexcept
+    {
+        stats = newStats;
+
+        if (activeSet != nullptr && activeSet->convolver != nullptr)
+            activeSet->convolver->setStats(newStats);
+        if (fadingSet != nullptr && fadingSet->convolver != nullptr)
+            fadingSet->convolver->setStats(newStats);
+    }
+   #endif
+
+    // ----------------------------------------------------------------------------------------------------------------
+    // realtime calls
+
+    // shorten the IR of current and future sets to a `ratio` of its full length
+    void setLength(const float ratio) noexcept
+    {
+        lengthRatio = ratio;
+    }
+
+    // pre-delay of current and future sets, in samples
+    void setPreDelay(const uint32_t samples) noexcept
+    {
+        preDelay = samples;
+    }
+
+    // morph amount of current and future sets, for those made from 2 IRs
+    void setMorph(const float amount) noexcept
+    {
+        morph = amount;
+    }
+
+    // latency of the set currently in use
+    uint32_t getLatency() const noexcept
+    {
+        return activeSet != nullptr ? activeSet->getLatency() : 0;
+    }
+
+    // convolve `frames` samples into the output buffers, returns false if there is nothing to convolve with
+    bool process(const float* const inL, const float* const inR, float* const outL, float* const outR,
+                 const uint32_t frames)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(frames <= bufferSize, false);
+
+        // cutting off a set still fading out would click, leave the new one pending until the crossfade is done
+        ConvolutionKernelSet* const newSet = fadingSet == nullptr ? pendingSet.exchange(nullptr) : nullptr;
+
+        if (newSet != nullptr)
+        {
+           #ifndef DISTRHO_OS_WASM
+            // nothing ran on the new set yet
+            if (newSet->convolver != nullptr)
+                newSet->convolver->setStats(stats);
+           #endif
+
+            fadingSet = activeSet;
+            activeSet = newSet;
+            crossfadeLength = crossfadeFrames;
+            crossfadePosition = 0;
+        }
+
+        const bool hasActive = activeSet != nullptr && !activeSet->isEmpty();
+        const bool hasFading = fadingSet != nullptr && !fadingSet->isEmpty();
+
+        if (!hasActive && !hasFading)
+        {
+            if (fadingSet != nullptr)
+            {
+                retire(fadingSet);
+                fadingSet = nullptr;
+            }
+            return false;
+        }
+
+        if (hasActive)
+        {
+            activeSet->setLength(lengthRatio);
+            activeSet->setPreDelay(preDelay);
+            activeSet->setMorph(morph);
+            activeSet->process(inL, inR, outL, outR, frames);
+        }
+        else
+        {
+            std::memset(outL, 0, sizeof(float) * frames);
+            std::memset(outR, 0, sizeof(float) * frames);
+        }
+
+        if (fadingSet == nullptr)
+            return true;
+
+        if (hasFading)
+        {
+            fadingSet->setLength(lengthRatio);
+            fadingSet->setPreDelay(preDelay);
+            fadingSet->setMorph(morph);
+            fadingSet->process(inL, inR, fadingBufL, fadingBufR, frames);
+        }
+        else
+        {
+            std::memset(fadingBufL, 0, sizeof(float) * frames);
+            std::memset(fadingBufR, 0, sizeof(float) * frames);
+        }
+
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            const float gain = std::min(1.f, static_cast<float>(crossfadePosition + i) / crossfadeLength);
+            outL[i] = outL[i] * gain + fadingBufL[i] * (1.f - gain);
+            outR[i] = outR[i] * gain + fadingBufR[i] * (1.f - gain);
+        }
+
+        crossfadePosition += frames;
+
+        if (crossfadePosition >= crossfadeLength)
+        {
+            retire(fadingSet);
+            fadingSet = nullptr;
+        }
+
+        return true;
+    }
+
+private:
+    ConvolutionKernelReclaimer::SharedInstance reclaimer;
+    std::atomic<ConvolutionKernelSet*> pendingSet;
+
+    // only touched by the audio thread
+    ConvolutionKernelSet* activeSet;
+    ConvolutionKernelSet* fadingSet;
+   #ifndef DISTRHO_OS_WASM
+    ConvolutionStats* stats;
+   #endif
+    uint32_t crossfadeFrames;
+    float lengthRatio;
+    float morph;
+    uint32_t preDelay;
+    uint32_t crossfadeLength;
+    uint32_t crossfadePosition;
+
+    // for processing the set being faded out
+    uint32_t bufferSize;
+    float* fadingBufL;
+    float* fadingBufR;
+
+    void retire(ConvolutionKernelSet* const set) noexcept
+    {
+        reclaimer->retire(set);
+    }
+
+    DISTRHO_DECLARE_NON_COPYABLE(ConvolutionKernelSwapper)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
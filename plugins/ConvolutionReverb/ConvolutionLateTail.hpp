@@ -0,0 +1,698 @@
+/*
+ * Convolution Late Tail
+ * Copyright (C) 2022-2023 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: ISC
+ */
+
+#pragma once
+
+#include "DistrhoUtils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// The IR decay is measured and matched in 3 bands, split at these frequencies in Hz.
+
+static constexpr const uint kConvolutionNumBands = 3;
+
+static inline double getConvolutionBandEdge(const uint edge) noexcept
+{
+    return edge == 0 ? 500.0 : 4000.0;
+}
+
+// added where filter and delay line states would otherwise decay into denormals, far under anything audible
+static constexpr const float kConvolutionAntiDenormal = 1e-20f;
+
+// --------------------------------------------------------------------------------------------------------------------
+// Splits a signal into the bands with 4th order Linkwitz-Riley filters, for measuring the level of each band.
+
+struct ConvolutionBandFilters {
+    struct Biquad {
+        double b0, b1, b2, a1, a2;
+        double z1, z2;
+
+        void init(const double sampleRate, const double frequency, const bool highpass) noexcept
+        {
+            // butterworth, Q of 1/sqrt(2)
+            const double w = 2.0 * M_PI * frequency / sampleRate;
+            const double alpha = std::sin(w) / std::sqrt(2.0);
+            const double cosw = std::cos(w);
+            const double a0 = 1.0 + alpha;
+
+            b1 = (highpass ? -(1.0 + cosw) : 1.0 - cosw) / a0;
+            b0 = b2 = (highpass ? 1.0 + cosw : 1.0 - cosw) * 0.5 / a0;
+            a1 = -2.0 * cosw / a0;
+            a2 = (1.0 - alpha) / a0;
+            z1 = z2 = 0.0;
+        }
+
+        double process(const double input) noexcept
+        {
+            const double output = b0 * input + z1;
+            z1 = b1 * input - a1 * output + z2;
+            z2 = b2 * input - a2 * output;
+            return output;
+        }
+    };
+
+    // lowpass for the low band, highpass then lowpass for the mid band, highpass for the high band.
+    // each one is 2 butterworth sections in series
+    Biquad filters[8];
+
+    void init(const double sampleRate) noexcept
+    {
+        for (uint i = 0; i < 2; ++i)
+        {
+            filters[i].init(sampleRate, getConvolutionBandEdge(0), false);
+            filters[2 + i].init(sampleRate, getConvolutionBandEdge(0), true);
+            filters[4 + i].init(sampleRate, getConvolutionBandEdge(1), false);
+            filters[6 + i].init(sampleRate, getConvolutionBandEdge(1), true);
+        }
+    }
+
+    void split(const float input, float bands[kConvolutionNumBands]) noexcept
+    {
+        const double value = input + kConvolutionAntiDenormal;
+        bands[0] = static_cast<float>(filters[1].process(filters[0].process(value)));
+        bands[1] = static_cast<float>(filters[5].process(filters[4].process(
+                                      filters[3].process(filters[2].process(value)))));
+        bands[2] = static_cast<float>(filters[7].process(filters[6].process(value)));
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// Cheap 3-band shelving filter made from a pair of one-pole lowpass filters, with a gain for each band.
+// Meant for running inside a feedback loop, the overall gain never goes over `getMaxGain(gains)` at any frequency.
+
+struct ConvolutionBandShelf {
+    float coeffs[2];
+    float lowpass[2];
+
+    void init(const double sampleRate) noexcept
+    {
+        for (uint i = 0; i < 2; ++i)
+            coeffs[i] = static_cast<float>(1.0 - std::exp(-2.0 * M_PI * getConvolutionBandEdge(i) / sampleRate));
+
+        reset();
+    }
+
+    void reset() noexcept
+    {
+        lowpass[0] = lowpass[1] = 0.f;
+    }
+
+    float process(const float input, const float gains[kConvolutionNumBands]) noexcept
+    {
+        lowpass[0] += coeffs[0] * (input - lowpass[0]);
+        lowpass[1] += coeffs[1] * (input - lowpass[1]);
+        return gains[2] * input + (gains[1] - gains[2]) * lowpass[1] + (gains[0] - gains[1]) * lowpass[0];
+    }
+
+    static float getMaxGain(const float gains[kConvolutionNumBands]) noexcept
+    {
+        return std::abs(gains[2]) + std::abs(gains[1] - gains[2]) + std::abs(gains[0] - gains[1]);
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// How the late part of an IR decays, for replacing it with a ConvolutionLateTail.
+// Independent of the sample rate, so it can be shared by kernels made for any.
+
+struct ConvolutionLateTailParameters {
+    static constexpr const uint kNumBands = kConvolutionNumBands;
+
+    // where the tail takes over from the convolved IR, in seconds from the start of the file.
+    // 0 if there is nothing left to take over
+    float onset;
+    // time for each band to decay by 60 dB, in seconds
+    float decayTimes[kNumBands];
+    // mean square level of each band at the onset, averaged over the IR channels
+    float levels[kNumBands];
+
+    ConvolutionLateTailParameters() noexcept
+        : onset(0.f),
+          decayTimes(),
+          levels() {}
+
+    bool isEnabled() const noexcept
+    {
+        return onset > 0.f;
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// Measures the decay of an IR in every band, fed in chunks while it is being decoded, like the ConvolutionTrimmer.
+//
+// Only the energy of every block of frames is kept. Decay times come from a line fitted to the first 20 dB
+// of the Schroeder energy decay curve of each band, starting from where the tail takes over.
+
+class ConvolutionDecayAnalyzer
+{
+public:
+    static constexpr const uint kNumBands = ConvolutionLateTailParameters::kNumBands;
+    static constexpr const size_t kBlockSize = 64;
+
+    // less than this is not worth replacing
+    static constexpr const size_t kMinTailBlocks = 4;
+
+    // decay times are kept within these, in seconds
+    static constexpr const float kMinDecayTime = 0.1f;
+    static constexpr const float kMaxDecayTime = 30.f;
+
+    ConvolutionDecayAnalyzer()
+        : numFrames(0),
+          numChannels(1),
+          blockEnergy() {}
+
+    // `numFramesHint` is only used for reserving memory upfront
+    void reset(const double sampleRate, const size_t numFramesHint = 0)
+    {
+        numFrames = 0;
+
+        for (uint c = 0; c < 4; ++c)
+            filters[c].init(sampleRate);
+
+        for (uint b = 0; b < kNumBands; ++b)
+        {
+            blockEnergy[b] = 0.0;
+            blockEnergies[b].clear();
+            blockEnergies[b].reserve(numFramesHint / kBlockSize + 1);
+        }
+    }
+
+    // analyze the first `numChannels` of `frames` interleaved frames with `numFileChannels` each
+    void process(const float* const interleaved, const uint numFileChannels, const uint numChannels_,
+                 const size_t frames)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(numChannels_ != 0 && numChannels_ <= 4,);
+
+        numChannels = numChannels_;
+
+        float bands[kNumBands];
+
+        for (size_t i = 0; i < frames; ++i)
+        {
+            for (uint c = 0; c < numChannels; ++c)
+            {
+                filters[c].split(interleaved[i * numFileChannels + c], bands);
+
+                for (uint b = 0; b < kNumBands; ++b)
+                    blockEnergy[b] += static_cast<double>(bands[b]) * bands[b];
+            }
+
+            if (++numFrames % kBlockSize == 0)
+                finishBlock();
+        }
+    }
+
+    // decay of everything after frame `onset`, nothing if its energy is under `tailFloor` dB of the total
+    ConvolutionLateTailParameters analyze(const double sampleRate, const size_t onset, const float tailFloor)
+    {
+        if (numFrames % kBlockSize != 0)
+            finishBlock();
+
+        ConvolutionLateTailParameters params;
+
+        const size_t numBlocks = blockEnergies[0].size();
+        const size_t onsetBlock = onset / kBlockSize;
+
+        if (onsetBlock + kMinTailBlocks > numBlocks)
+            return params;
+
+        double totalEnergy = 0.0;
+        double tailEnergy = 0.0;
+        double remaining[kNumBands] = {};
+
+        for (uint b = 0; b < kNumBands; ++b)
+        {
+            for (size_t k = 0; k < numBlocks; ++k)
+            {
+                totalEnergy += blockEnergies[b][k];
+
+                if (k >= onsetBlock)
+                    remaining[b] += blockEnergies[b][k];
+            }
+
+            tailEnergy += remaining[b];
+        }
+
+        if (tailEnergy <= totalEnergy * std::pow(10.0, 0.1 * tailFloor))
+            return params;
+
+        for (uint b = 0; b < kNumBands; ++b)
+        {
+            const float decayTime = fitDecayTime(blockEnergies[b], onsetBlock, remaining[b], sampleRate);
+
+            // all of the remaining energy spread over an exponential decay gives its starting level
+            const double decayRate = std::log(1e6) / (decayTime * sampleRate);
+
+            params.decayTimes[b] = decayTime;
+            params.levels[b] = static_cast<float>(remaining[b] / numChannels * (1.0 - std::exp(-decayRate)));
+        }
+
+        params.onset = static_cast<float>(onset / sampleRate);
+        return params;
+    }
+
+private:
+    size_t numFrames;
+    uint numChannels;
+    ConvolutionBandFilters filters[4];
+    double blockEnergy[kNumBands];
+    std::vector<double> blockEnergies[kNumBands];
+
+    void finishBlock()
+    {
+        for (uint b = 0; b < kNumBands; ++b)
+        {
+            blockEnergies[b].push_back(blockEnergy[b]);
+            blockEnergy[b] = 0.0;
+        }
+    }
+
+    // least squares line over the energy decay curve in dB, from `onsetBlock` until 20 dB under it
+    static float fitDecayTime(const std::vector<double>& energies, const size_t onsetBlock,
+                              const double remaining, const double sampleRate)
+    {
+        if (remaining <= 0.0)
+            return kMinDecayTime;
+
+        const double stopEnergy = remaining * 0.01;
+        double curve = remaining;
+        double sumX = 0.0, sumY = 0.0, sumXX = 0.0, sumXY = 0.0;
+        size_t n = 0;
+
+        for (size_t k = onsetBlock; k < energies.size() && curve > stopEnergy; ++k, ++n)
+        {
+            const double x = static_cast<double>((k - onsetBlock) * kBlockSize) / sampleRate;
+            const double y = 10.0 * std::log10(curve);
+            sumX += x;
+            sumY += y;
+            sumXX += x * x;
+            sumXY += x * y;
+            curve -= energies[k];
+        }
+
+        if (n < 2)
+            return kMinDecayTime;
+
+        const double slope = (n * sumXY - sumX * sumY) / (n * sumXX - sumX * sumX);
+
+        if (! (slope < 0.0))
+            return kMaxDecayTime;
+
+        const float decayTime = static_cast<float>(-60.0 / slope);
+        return decayTime < kMinDecayTime ? kMinDecayTime : decayTime > kMaxDecayTime ? kMaxDecayTime : decayTime;
+    }
+
+    DISTRHO_DECLARE_NON_COPYABLE(ConvolutionDecayAnalyzer)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// Feedback delay network standing in for the late part of a long IR, which is then not convolved at all.
+//
+// 8 delay lines are mixed through a Hadamard matrix, each one with a 3-band loss filter matching the measured
+// decay times. The input goes through a few allpass diffusers first, so the first echoes are already dense.
+// The input is delayed so the output starts at the tail onset, right where the convolved IR fades out,
+// at a level calibrated on init by running an impulse through the network.
+//
+// CPU and memory use only depend on the sample rate and maximum pre-delay, never on the length of the IR.
+
+class ConvolutionLateTail
+{
+    static constexpr const uint kNumBands = ConvolutionLateTailParameters::kNumBands;
+    static constexpr const uint kNumLines = 8;
+    static constexpr const uint kNumDiffusers = 4;
+    static constexpr const float kDiffuserGain = 0.6f;
+
+    // under this the tail is considered to have rung out
+    static constexpr const float kSilenceLevel = 1e-6f;
+
+public:
+    ConvolutionLateTail()
+        : sampleRate(0.0),
+          lengthRatio(1.f),
+          maxPreDelay(0),
+          baseDelay(0),
+          inputDelay(0),
+          inputPosition(0),
+          silentFrames(0),
+          flushFrames(0),
+          idle(true) {}
+
+    // returns false if the parameters have no tail to produce.
+    // true stereo IRs feed both outputs from both inputs, otherwise the level is set for a centered input.
+    bool init(const ConvolutionLateTailParameters& params_, const double sampleRate_, const size_t maxPreDelay_,
+              const bool trueStereo)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(params_.isEnabled(), false);
+
+        // lengths at 48kHz, coprime and spread over 20 to 60 ms
+        static constexpr const uint kLineLengths[kNumLines] = { 1031, 1327, 1523, 1801, 2053, 2311, 2621, 2927 };
+        static constexpr const uint kDiffuserLengths[2][kNumDiffusers] = {
+            { 227, 347, 563, 797 },
+            { 241, 359, 577, 821 }
+        };
+
+        params = params_;
+        sampleRate = sampleRate_;
+        lengthRatio = 1.f;
+        maxPreDelay = maxPreDelay_;
+
+        const double scale = sampleRate / 48000.0;
+        size_t totalLineLength = 0;
+        size_t maxLineLength = 0;
+        size_t diffuserLength = 0;
+
+        for (uint l = 0; l < kNumLines; ++l)
+        {
+            const size_t length = std::max<size_t>(1, static_cast<size_t>(kLineLengths[l] * scale + 0.5));
+            lines[l].assign(length, 0.f);
+            totalLineLength += length;
+            maxLineLength = std::max(maxLineLength, length);
+            lossFilters[l].init(sampleRate);
+
+            // rows of a Hadamard matrix, orthogonal to each other and to the all-ones row
+            for (uint c = 0; c < 2; ++c)
+            {
+                inputSigns[c][l] = __builtin_parity((c + 1) & l) ? -1.f : 1.f;
+                outputSigns[c][l] = __builtin_parity((c + 5) & l) ? -1.f : 1.f;
+            }
+        }
+
+        for (uint c = 0; c < 2; ++c)
+        {
+            inputFilters[c].init(sampleRate);
+
+            for (uint d = 0; d < kNumDiffusers; ++d)
+            {
+                const size_t length = std::max<size_t>(1, static_cast<size_t>(kDiffuserLengths[c][d] * scale + 0.5));
+                diffusers[c][d].assign(length, 0.f);
+                diffuserLength = std::max(diffuserLength, length);
+            }
+        }
+
+        updateLossGains();
+
+        // the network output builds up over about a line length, its onset is put halfway through that.
+        // the convolved IR should fade out over the same time.
+        const size_t reference = totalLineLength / kNumLines;
+
+        // measure the network level at its onset, as the mean square level of its decay extended back to it,
+        // starting from a flat input. the input shelves overlap, so the gains need a few rounds to settle
+        for (uint b = 0; b < kNumBands; ++b)
+            inputGains[b] = 1.f;
+
+        for (uint round = 0; round < 3; ++round)
+        {
+            float measured[kNumBands];
+            measure(reference, maxLineLength * 2 + diffuserLength * kNumDiffusers, trueStereo, measured);
+
+            for (uint b = 0; b < kNumBands; ++b)
+                inputGains[b] = measured[b] > 0.f ? inputGains[b] * std::sqrt(params.levels[b] / measured[b]) : 0.f;
+        }
+
+        const size_t onset = static_cast<size_t>(params.onset * sampleRate + 0.5);
+        baseDelay = onset > reference ? onset - reference : 0;
+        inputDelay = baseDelay;
+
+        for (uint c = 0; c < 2; ++c)
+            inputBuffers[c].assign(baseDelay + maxPreDelay + 1, 0.f);
+
+        flushFrames = inputBuffers[0].size() + maxLineLength + diffuserLength * kNumDiffusers;
+
+        reset();
+        return true;
+    }
+
+    void reset()
+    {
+        for (uint c = 0; c < 2; ++c)
+        {
+            std::fill(inputBuffers[c].begin(), inputBuffers[c].end(), 0.f);
+            inputFilters[c].reset();
+
+            for (uint d = 0; d < kNumDiffusers; ++d)
+            {
+                std::fill(diffusers[c][d].begin(), diffusers[c][d].end(), 0.f);
+                diffuserPositions[c][d] = 0;
+            }
+        }
+
+        for (uint l = 0; l < kNumLines; ++l)
+        {
+            std::fill(lines[l].begin(), lines[l].end(), 0.f);
+            linePositions[l] = 0;
+            lossFilters[l].reset();
+        }
+
+        inputPosition = 0;
+        silentFrames = 0;
+        idle = true;
+    }
+
+    // scale all decay times by `ratio`
+    void setLength(const float ratio)
+    {
+        if (d_isEqual(lengthRatio, ratio))
+            return;
+
+        lengthRatio = ratio;
+        updateLossGains();
+    }
+
+    // delay the input by `samples`, up to the maximum given on init
+    void setPreDelay(const uint32_t samples) noexcept
+    {
+        inputDelay = baseDelay + std::min<size_t>(samples, maxPreDelay);
+    }
+
+    // add the tail for `frames` samples of input to the outputs
+    void process(const float* const ins[2], float* const outs[2], const uint32_t frames)
+    {
+        const bool inputSilent = isSilent(ins[0], frames) && isSilent(ins[1], frames);
+
+        if (idle)
+        {
+            if (inputSilent)
+                return;
+
+            idle = false;
+        }
+
+        const size_t inputSize = inputBuffers[0].size();
+        float peak = 0.f;
+
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            const size_t readPosition = inputPosition >= inputDelay ? inputPosition - inputDelay
+                                                                    : inputPosition + inputSize - inputDelay;
+            inputBuffers[0][inputPosition] = ins[0][i];
+            inputBuffers[1][inputPosition] = ins[1][i];
+
+            if (++inputPosition == inputSize)
+                inputPosition = 0;
+
+            const float input[2] = { inputBuffers[0][readPosition], inputBuffers[1][readPosition] };
+            float output[2];
+            tick(input, output, peak);
+            outs[0][i] += output[0];
+            outs[1][i] += output[1];
+        }
+
+        // once the input stopped long enough for everything to leave the network, skip it until there is more
+        if (inputSilent && peak < kSilenceLevel)
+        {
+            silentFrames += frames;
+
+            if (silentFrames >= flushFrames)
+                reset();
+        }
+        else
+        {
+            silentFrames = 0;
+        }
+    }
+
+private:
+    ConvolutionLateTailParameters params;
+    double sampleRate;
+    float lengthRatio;
+
+    // pre-delay plus the time until the tail onset
+    std::vector<float> inputBuffers[2];
+    size_t maxPreDelay;
+    size_t baseDelay;
+    size_t inputDelay;
+    size_t inputPosition;
+    ConvolutionBandShelf inputFilters[2];
+    float inputGains[kNumBands];
+
+    std::vector<float> diffusers[2][kNumDiffusers];
+    size_t diffuserPositions[2][kNumDiffusers];
+
+    std::vector<float> lines[kNumLines];
+    size_t linePositions[kNumLines];
+    ConvolutionBandShelf lossFilters[kNumLines];
+    float lossGains[kNumLines][kNumBands];
+    float inputSigns[2][kNumLines];
+    float outputSigns[2][kNumLines];
+
+    size_t silentFrames;
+    size_t flushFrames;
+    bool idle;
+
+    static bool isSilent(const float* const data, const uint32_t frames) noexcept
+    {
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            if (data[i] != 0.f)
+                return false;
+        }
+
+        return true;
+    }
+
+    void updateLossGains()
+    {
+        for (uint l = 0; l < kNumLines; ++l)
+        {
+            const double length = static_cast<double>(lines[l].size());
+
+            for (uint b = 0; b < kNumBands; ++b)
+                lossGains[l][b] = static_cast<float>(
+                    std::pow(10.0, -3.0 * length / (params.decayTimes[b] * lengthRatio * sampleRate)));
+
+            // band gains that do not fall with frequency can overshoot in between, which must never reach 1
+            const float maxGain = ConvolutionBandShelf::getMaxGain(lossGains[l]);
+
+            if (maxGain > 0.9999f)
+            {
+                for (uint b = 0; b < kNumBands; ++b)
+                    lossGains[l][b] *= 0.9999f / maxGain;
+            }
+        }
+    }
+
+    // one sample through the network, keeping track of the peak level inside it
+    void tick(const float input[2], float output[2], float& peak)
+    {
+        float diffused[2];
+
+        for (uint c = 0; c < 2; ++c)
+        {
+            float value = inputFilters[c].process(input[c] + kConvolutionAntiDenormal, inputGains)
+                        + kConvolutionAntiDenormal;
+
+            for (uint d = 0; d < kNumDiffusers; ++d)
+            {
+                std::vector<float>& buffer(diffusers[c][d]);
+                size_t& position(diffuserPositions[c][d]);
+
+                const float delayed = buffer[position];
+                const float stored = value + kDiffuserGain * delayed;
+                buffer[position] = stored;
+                value = delayed - kDiffuserGain * stored;
+
+                if (++position == buffer.size())
+                    position = 0;
+            }
+
+            diffused[c] = value;
+        }
+
+        // the same scale keeps the mixing matrix orthogonal, and the input and output unity overall
+        static constexpr const float kScale = 0.35355339f; // 1/sqrt(8)
+
+        float mixed[kNumLines];
+        output[0] = output[1] = 0.f;
+
+        for (uint l = 0; l < kNumLines; ++l)
+        {
+            const float value = lossFilters[l].process(lines[l][linePositions[l]], lossGains[l]);
+            mixed[l] = value;
+            output[0] += outputSigns[0][l] * value;
+            output[1] += outputSigns[1][l] * value;
+            peak = std::max(peak, std::abs(value));
+        }
+
+        output[0] *= kScale;
+        output[1] *= kScale;
+
+        for (uint h = 1; h < kNumLines; h <<= 1)
+        {
+            for (uint i = 0; i < kNumLines; i += h * 2)
+            {
+                for (uint j = i; j < i + h; ++j)
+                {
+                    const float a = mixed[j];
+                    const float b = mixed[j + h];
+                    mixed[j] = a + b;
+                    mixed[j + h] = a - b;
+                }
+            }
+        }
+
+        for (uint l = 0; l < kNumLines; ++l)
+        {
+            lines[l][linePositions[l]] = kScale * (mixed[l] + inputSigns[0][l] * diffused[0]
+                                                            + inputSigns[1][l] * diffused[1])
+                                       + kConvolutionAntiDenormal;
+
+            if (++linePositions[l] == lines[l].size())
+                linePositions[l] = 0;
+        }
+    }
+
+    // run an impulse through the network, without any input delay, and find the level of each band of the
+    // left output at `reference` frames, from its decay measured after `start` frames
+    void measure(const size_t reference, const size_t start, const bool trueStereo, float levels[kNumBands])
+    {
+        reset();
+
+        const size_t end = start + static_cast<size_t>(0.2 * sampleRate);
+        ConvolutionBandFilters filters;
+        filters.init(sampleRate);
+
+        double energies[kNumBands] = {};
+        double weights[kNumBands] = {};
+        double decayRates[kNumBands];
+
+        for (uint b = 0; b < kNumBands; ++b)
+            decayRates[b] = std::log(1e6) / (params.decayTimes[b] * sampleRate);
+
+        float peak = 0.f;
+        float bands[kNumBands];
+
+        for (size_t i = 0; i < end; ++i)
+        {
+            const float impulse = i == 0 ? 1.f : 0.f;
+            const float input[2] = { impulse, trueStereo ? 0.f : impulse };
+            float output[2];
+            tick(input, output, peak);
+            filters.split(output[0], bands);
+
+            if (i < start)
+                continue;
+
+            for (uint b = 0; b < kNumBands; ++b)
+            {
+                energies[b] += static_cast<double>(bands[b]) * bands[b];
+                weights[b] += std::exp(-decayRates[b] * static_cast<double>(i - reference));
+            }
+        }
+
+        for (uint b = 0; b < kNumBands; ++b)
+            levels[b] = weights[b] > 0.0 ? static_cast<float>(energies[b] / weights[b]) : 0.f;
+    }
+
+    DISTRHO_DECLARE_NON_COPYABLE(ConvolutionLateTail)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
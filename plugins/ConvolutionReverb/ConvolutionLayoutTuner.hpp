@@ -0,0 +1,388 @@
+/*
+ * Convolution Layout Tuner
+ * Copyright (C) 2022-2023 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: ISC
+ */
+
+#pragma once
+
+#include "ConvolutionKernelDiskCache.hpp"
+#include "MultiStageThreadedConvolver.hpp"
+
+#ifdef DISTRHO_OS_MAC
+# include <sys/sysctl.h>
+#endif
+
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <thread>
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// Picks the partition layout that runs cheapest on this machine, for a given buffer size and IR length.
+//
+// Candidate layouts are benchmarked on a synthetic IR the first time a configuration is seen,
+// entirely in the calling thread so the shared realtime workers are left alone, scored by its own CPU time.
+// The winner is remembered in memory and in a small file next to the kernel disk cache,
+// keyed by CPU model, sample rate, buffer size, fixed head block size (if any) and IR length bucket.
+
+class ConvolutionLayoutTuner
+{
+public:
+    static ConvolutionLayoutTuner& getInstance()
+    {
+        static ConvolutionLayoutTuner tuner;
+        return tuner;
+    }
+
+    // `fixedHeadBlockSize` forces the head block size, 0 lets the tuner choose it as well.
+    // benchmarking can take a while, only call this from a background thread.
+    ConvolutionLayout getLayout(const uint32_t bufferSize, const uint32_t fixedHeadBlockSize,
+                                const size_t irLength, const double sampleRate)
+    {
+        ConvolutionLayout layout;
+
+        if (fixedHeadBlockSize != 0)
+            layout.headBlockSize = fixedHeadBlockSize;
+
+       #ifndef DISTRHO_OS_WASM
+        if (bufferSize == 0 || irLength == 0)
+            return layout;
+
+        const Entry key = {
+            static_cast<uint32_t>(std::lround(sampleRate)),
+            bufferSize, fixedHeadBlockSize, getLengthBucket(irLength), layout
+        };
+
+        if (find(key, layout))
+            return layout;
+
+        // one benchmark at a time, they would only skew each other otherwise
+        const MutexLocker cml(benchmarkMutex);
+
+        // someone else might have just benchmarked the same configuration
+        if (find(key, layout))
+            return layout;
+
+        layout = benchmark(key);
+
+        Entry entry = key;
+        entry.layout = layout;
+
+        {
+            const MutexLocker cml2(mutex);
+            entries.push_back(entry);
+        }
+
+        save(entry);
+       #else
+        // no threads and no disk, just use the defaults
+        (void)bufferSize;
+        (void)irLength;
+        (void)sampleRate;
+       #endif
+
+        return layout;
+    }
+
+private:
+    struct Entry {
+        uint32_t sampleRate;
+        uint32_t bufferSize;
+        uint32_t fixedHeadBlockSize;
+        uint32_t lengthBucket;
+        ConvolutionLayout layout;
+    };
+
+    // IR lengths are grouped by powers of 2, starting at this one
+    static constexpr const uint32_t kMinLengthBucket = 12;
+    static constexpr const uint32_t kMaxLengthBucket = 22;
+
+    Mutex mutex;
+    Mutex benchmarkMutex;
+    std::vector<Entry> entries;
+    uint64_t cpuHash;
+    bool loaded;
+
+    ConvolutionLayoutTuner()
+        : cpuHash(0),
+          loaded(false) {}
+
+    static uint32_t getLengthBucket(const size_t irLength) noexcept
+    {
+        uint32_t bucket = kMinLengthBucket;
+        while (bucket < kMaxLengthBucket && (static_cast<size_t>(1) << bucket) < irLength)
+            ++bucket;
+        return bucket;
+    }
+
+   #ifndef DISTRHO_OS_WASM
+    bool find(const Entry& key, ConvolutionLayout& layout)
+    {
+        const MutexLocker cml(mutex);
+
+        if (! loaded)
+        {
+            loaded = true;
+            cpuHash = getCpuHash();
+            load();
+        }
+
+        // later entries win, in case the file got appended to by different processes
+        for (size_t i = entries.size(); i-- != 0;)
+        {
+            const Entry& entry(entries[i]);
+
+            if (entry.sampleRate == key.sampleRate &&
+                entry.bufferSize == key.bufferSize &&
+                entry.fixedHeadBlockSize == key.fixedHeadBlockSize &&
+                entry.lengthBucket == key.lengthBucket)
+            {
+                layout = entry.layout;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // runs every candidate layout twice over a noise IR, keeping the one with the least CPU time for all stages.
+    // candidates that make a single block take longer than half its duration are only used as last resort,
+    // that only counts the time the audio thread would spend, not the background stages run along with it here.
+    // single blocks are timed with the wall clock, thread CPU time is too coarse for them on some systems.
+    static ConvolutionLayout benchmark(const Entry& key)
+    {
+        const size_t irLength = static_cast<size_t>(1) << key.lengthBucket;
+        const uint32_t bufferSize = key.bufferSize;
+        const double sampleRate = key.sampleRate;
+
+        std::vector<float> ir(irLength);
+        std::vector<float> input(bufferSize);
+        std::vector<float> output(bufferSize);
+
+        std::minstd_rand rng(1);
+        std::uniform_real_distribution<float> dist(-1.f, 1.f);
+
+        for (size_t i = 0; i < irLength; ++i)
+            ir[i] = dist(rng) * std::exp(-6.9f * static_cast<float>(i) / static_cast<float>(irLength));
+
+        for (uint32_t i = 0; i < bufferSize; ++i)
+            input[i] = dist(rng);
+
+        ConvolutionLayout candidates[16];
+        const uint numCandidates = getCandidates(key, candidates);
+
+        ConvolutionLayout best = candidates[0];
+        double bestScore = 0.0;
+        bool bestIsSafe = false;
+
+        for (uint c = 0; c < numCandidates; ++c)
+        {
+            const std::shared_ptr<const ConvolutionKernel> kernel(
+                ConvolutionKernel::create(ir.data(), irLength, candidates[c]));
+
+            if (kernel == nullptr)
+                continue;
+
+            // run long enough for the slowest stage to complete a few blocks
+            const size_t lastBlockSize = kernel->getStage(kernel->getNumStages() - 1).blockSize;
+            const size_t numFrames = std::min<size_t>(1 << 19, std::max<size_t>(1 << 16, lastBlockSize * 4));
+            const double blockDuration = bufferSize / sampleRate;
+
+            double score = 0.0;
+            double worstBlock = 0.0;
+
+            for (uint run = 0; run < 2; ++run)
+            {
+                uint64_t backgroundNs = 0;
+
+                MultiStageThreadedConvolver convolver;
+                convolver.setRunInline(&backgroundNs);
+                if (! convolver.init(kernel, sampleRate, bufferSize))
+                    break;
+
+                const uint64_t cpuStartNs = ConvolutionWorkerPool::getThreadTimeNs();
+
+                for (size_t frame = 0; frame < numFrames; frame += bufferSize)
+                {
+                    const uint64_t startNs = ConvolutionWorkerPool::getTimeNs();
+                    const uint64_t backgroundStartNs = backgroundNs;
+                    convolver.process(input.data(), output.data(), bufferSize);
+                    const uint64_t elapsedNs = ConvolutionWorkerPool::getTimeNs() - startNs
+                                             - (backgroundNs - backgroundStartNs);
+                    worstBlock = std::max(worstBlock, elapsedNs * 1e-9);
+                }
+
+                const double cpuTime = (ConvolutionWorkerPool::getThreadTimeNs() - cpuStartNs) * 1e-9;
+                score = run == 0 ? cpuTime : std::min(score, cpuTime);
+            }
+
+            // per processed sample, so candidates running for different lengths compare fairly
+            score /= numFrames;
+
+            const bool isSafe = worstBlock < blockDuration * 0.5;
+
+            if (c == 0 || (isSafe && ! bestIsSafe) || (isSafe == bestIsSafe && score < bestScore))
+            {
+                best = candidates[c];
+                bestScore = score;
+                bestIsSafe = isSafe;
+            }
+        }
+
+        return best;
+    }
+
+    static uint getCandidates(const Entry& key, ConvolutionLayout candidates[16])
+    {
+        uint count = 0;
+
+        // heads around the buffer size, much smaller only adds partitions, much larger recomputes partial blocks.
+        // small buffers get heads done in the time domain, which recompute nothing, up to their largest size.
+        const uint32_t bufferSizePow2 = d_nextPowerOf2(key.bufferSize);
+        const uint32_t maxDirectHead = MultiStageThreadedConvolver::kMaxDirectHeadSize;
+        const uint32_t minHead = key.fixedHeadBlockSize != 0 ? key.fixedHeadBlockSize
+                                                             : std::max(64U, bufferSizePow2 / 8);
+        const uint32_t maxHead = key.fixedHeadBlockSize != 0 ? key.fixedHeadBlockSize
+                                                             : std::min(1024U, std::max(maxDirectHead, bufferSizePow2));
+
+        for (uint32_t head = minHead; head <= maxHead && count < 16; head *= 2)
+        {
+            // smaller growth needs an extra stage for covering a similar IR length
+            for (uint32_t growth = 4; growth <= 16 && count < 16; growth *= 2)
+            {
+                ConvolutionLayout& layout(candidates[count++]);
+                layout.headBlockSize = head;
+                layout.stageGrowthFactor = growth;
+                layout.maxStages = growth == 4 ? 5 : growth == 8 ? 4 : 3;
+            }
+        }
+
+        return count;
+    }
+
+    static String getCpuModel()
+    {
+        String model;
+
+       #if defined(DISTRHO_OS_MAC)
+        char brand[256] = {};
+        size_t brandSize = sizeof(brand) - 1;
+        if (::sysctlbyname("machdep.cpu.brand_string", brand, &brandSize, nullptr, 0) == 0)
+            model = brand;
+       #elif defined(DISTRHO_OS_WINDOWS)
+        if (const char* const identifier = std::getenv("PROCESSOR_IDENTIFIER"))
+            model = identifier;
+       #else
+        if (FILE* const fd = std::fopen("/proc/cpuinfo", "r"))
+        {
+            char line[256];
+            while (std::fgets(line, sizeof(line), fd) != nullptr)
+            {
+                if (std::strncmp(line, "model name", 10) == 0)
+                {
+                    model = line;
+                    break;
+                }
+            }
+            std::fclose(fd);
+        }
+       #endif
+
+        // the same model can still come with a different amount of cores to run background stages on
+        char threads[32];
+        std::snprintf(threads, sizeof(threads), " x%u", std::thread::hardware_concurrency());
+        model += threads;
+
+        return model;
+    }
+
+    static uint64_t getCpuHash()
+    {
+        const String model(getCpuModel());
+        const char* const str = model.buffer();
+
+        // FNV-1a
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (size_t i = 0, len = model.length(); i < len; ++i)
+        {
+            hash ^= static_cast<uint8_t>(str[i]);
+            hash *= 0x100000001b3ULL;
+        }
+
+        return hash;
+    }
+
+    static String getFilename()
+    {
+        const String dir(ConvolutionKernelDiskCache::getCacheDirectory());
+
+        if (dir.isEmpty())
+            return String();
+
+        return dir + DISTRHO_OS_SEP_STR "layouts.txt";
+    }
+
+    // one line per entry: cpu hash, sample rate, buffer size, fixed head, length bucket, head, growth, stages
+    void load()
+    {
+        const String filename(getFilename());
+
+        if (filename.isEmpty())
+            return;
+
+        FILE* const fd = std::fopen(filename, "r");
+
+        if (fd == nullptr)
+            return;
+
+        unsigned long long hash;
+        Entry entry;
+
+        while (std::fscanf(fd, "%llx %u %u %u %u %u %u %u\n", &hash,
+                           &entry.sampleRate, &entry.bufferSize, &entry.fixedHeadBlockSize, &entry.lengthBucket,
+                           &entry.layout.headBlockSize, &entry.layout.stageGrowthFactor,
+                           &entry.layout.maxStages) == 8)
+        {
+            if (hash != cpuHash)
+                continue;
+
+            // ignore anything that would not make a valid kernel
+            if (entry.layout.headBlockSize == 0 || entry.layout.stageGrowthFactor < 2 ||
+                entry.layout.maxStages == 0 || entry.layout.maxStages > ConvolutionKernel::kMaxStages)
+                continue;
+
+            entries.push_back(entry);
+        }
+
+        std::fclose(fd);
+    }
+
+    void save(const Entry& entry)
+    {
+        const String filename(getFilename());
+
+        if (filename.isEmpty())
+            return;
+
+        FILE* const fd = std::fopen(filename, "a");
+
+        if (fd == nullptr)
+            return;
+
+        std::fprintf(fd, "%016llx %u %u %u %u %u %u %u\n", static_cast<unsigned long long>(cpuHash),
+                     entry.sampleRate, entry.bufferSize, entry.fixedHeadBlockSize, entry.lengthBucket,
+                     entry.layout.headBlockSize, entry.layout.stageGrowthFactor, entry.layout.maxStages);
+
+        std::fclose(fd);
+    }
+   #endif
+
+    DISTRHO_DECLARE_NON_COPYABLE(ConvolutionLayoutTuner)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
@@ -0,0 +1,400 @@
+/*
+ * Convolution SIMD
+ * Copyright (C) 2022-2023 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: ISC
+ */
+
+#pragma once
+
+#include "ConvolutionKernel.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define CONVOLUTION_SIMD_X86
+# include <immintrin.h>
+#endif
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// Complex multiply-accumulate over split real/imaginary arrays, the inner loop of every partitioned convolution,
+// and a direct-form FIR for heads convolved in the time domain.
+//
+// On x86 the SSE2, AVX2 (with FMA) or AVX-512 version is picked at runtime from what the CPU supports,
+// so a single binary does not need to be built for the lowest common denominator.
+// Everything else gets a plain loop, left for the compiler to vectorize.
+// No alignment is required, partitions and delay line segments are laid out back to back at odd sizes.
+
+class ConvolutionSIMD
+{
+public:
+    // result += a * b
+    typedef void (*MultiplyAccumulateFunc)(float* resultRe, float* resultIm,
+                                           const float* aRe, const float* aIm,
+                                           const float* bRe, const float* bIm, size_t size);
+
+    // result += a * gain * b, with `a` in compact (bfloat16) form
+    typedef void (*CompactMultiplyAccumulateFunc)(float* resultRe, float* resultIm,
+                                                  const ConvolutionKernel::CompactSample* aRe,
+                                                  const ConvolutionKernel::CompactSample* aIm,
+                                                  const float* bRe, const float* bIm, size_t size, float gain);
+
+    // output[n] += gain * sum(taps[k] * input[n + k]) for every k < numTaps, a FIR with its taps reversed.
+    // `input` starts at the oldest sample needed for output[0], and is read up to `size + numTaps - 1` samples.
+    typedef void (*FIRFunc)(float* output, const float* input, const float* taps, size_t numTaps,
+                            size_t size, float gain);
+
+    MultiplyAccumulateFunc multiplyAccumulate;
+    CompactMultiplyAccumulateFunc compactMultiplyAccumulate;
+    FIRFunc fir;
+
+    // for reporting, one of "generic", "sse2", "avx2" or "avx512"
+    const char* name;
+
+    static const ConvolutionSIMD& getInstance()
+    {
+        static const ConvolutionSIMD simd;
+        return simd;
+    }
+
+private:
+    ConvolutionSIMD()
+        : multiplyAccumulate(Generic::multiplyAccumulate),
+          compactMultiplyAccumulate(Generic::compactMultiplyAccumulate),
+          fir(Generic::fir),
+          name("generic")
+    {
+       #ifdef CONVOLUTION_SIMD_X86
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx512f"))
+        {
+            multiplyAccumulate = AVX512::multiplyAccumulate;
+            compactMultiplyAccumulate = AVX512::compactMultiplyAccumulate;
+            fir = AVX512::fir;
+            name = "avx512";
+        }
+        else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            multiplyAccumulate = AVX2::multiplyAccumulate;
+            compactMultiplyAccumulate = AVX2::compactMultiplyAccumulate;
+            fir = AVX2::fir;
+            name = "avx2";
+        }
+        else if (__builtin_cpu_supports("sse2"))
+        {
+            multiplyAccumulate = SSE2::multiplyAccumulate;
+            compactMultiplyAccumulate = SSE2::compactMultiplyAccumulate;
+            fir = SSE2::fir;
+            name = "sse2";
+        }
+       #endif
+    }
+
+    struct Generic {
+        static void multiplyAccumulate(float* const re, float* const im,
+                                       const float* const aRe, const float* const aIm,
+                                       const float* const bRe, const float* const bIm,
+                                       const size_t size) noexcept
+        {
+            for (size_t k = 0; k < size; ++k)
+            {
+                re[k] += aRe[k] * bRe[k] - aIm[k] * bIm[k];
+                im[k] += aRe[k] * bIm[k] + aIm[k] * bRe[k];
+            }
+        }
+
+        static void compactMultiplyAccumulate(float* const re, float* const im,
+                                              const ConvolutionKernel::CompactSample* const aRe,
+                                              const ConvolutionKernel::CompactSample* const aIm,
+                                              const float* const bRe, const float* const bIm,
+                                              const size_t size, const float gain) noexcept
+        {
+            for (size_t k = 0; k < size; ++k)
+            {
+                const float ar = ConvolutionKernel::fromCompact(aRe[k]) * gain;
+                const float ai = ConvolutionKernel::fromCompact(aIm[k]) * gain;
+                re[k] += ar * bRe[k] - ai * bIm[k];
+                im[k] += ar * bIm[k] + ai * bRe[k];
+            }
+        }
+
+        static void fir(float* const output, const float* const input, const float* const taps,
+                        const size_t numTaps, const size_t size, const float gain) noexcept
+        {
+            for (size_t n = 0; n < size; ++n)
+            {
+                float sum = 0.f;
+
+                for (size_t k = 0; k < numTaps; ++k)
+                    sum += taps[k] * input[n + k];
+
+                output[n] += sum * gain;
+            }
+        }
+    };
+
+   #ifdef CONVOLUTION_SIMD_X86
+    // bfloat16 is the upper half of a float, widening is a zero-extend and shift
+    struct SSE2 {
+        __attribute__((target("sse2")))
+        static void multiplyAccumulate(float* const re, float* const im,
+                                       const float* const aRe, const float* const aIm,
+                                       const float* const bRe, const float* const bIm,
+                                       const size_t size) noexcept
+        {
+            size_t k = 0;
+
+            for (; k + 4 <= size; k += 4)
+            {
+                const __m128 ar = _mm_loadu_ps(aRe + k);
+                const __m128 ai = _mm_loadu_ps(aIm + k);
+                const __m128 br = _mm_loadu_ps(bRe + k);
+                const __m128 bi = _mm_loadu_ps(bIm + k);
+
+                _mm_storeu_ps(re + k, _mm_add_ps(_mm_loadu_ps(re + k),
+                                                 _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi))));
+                _mm_storeu_ps(im + k, _mm_add_ps(_mm_loadu_ps(im + k),
+                                                 _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br))));
+            }
+
+            Generic::multiplyAccumulate(re + k, im + k, aRe + k, aIm + k, bRe + k, bIm + k, size - k);
+        }
+
+        __attribute__((target("sse2")))
+        static void compactMultiplyAccumulate(float* const re, float* const im,
+                                              const ConvolutionKernel::CompactSample* const aRe,
+                                              const ConvolutionKernel::CompactSample* const aIm,
+                                              const float* const bRe, const float* const bIm,
+                                              const size_t size, const float gain) noexcept
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128 g = _mm_set1_ps(gain);
+            size_t k = 0;
+
+            for (; k + 4 <= size; k += 4)
+            {
+                const __m128i ar16 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(aRe + k));
+                const __m128i ai16 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(aIm + k));
+                const __m128 ar = _mm_mul_ps(_mm_castsi128_ps(_mm_unpacklo_epi16(zero, ar16)), g);
+                const __m128 ai = _mm_mul_ps(_mm_castsi128_ps(_mm_unpacklo_epi16(zero, ai16)), g);
+                const __m128 br = _mm_loadu_ps(bRe + k);
+                const __m128 bi = _mm_loadu_ps(bIm + k);
+
+                _mm_storeu_ps(re + k, _mm_add_ps(_mm_loadu_ps(re + k),
+                                                 _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi))));
+                _mm_storeu_ps(im + k, _mm_add_ps(_mm_loadu_ps(im + k),
+                                                 _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br))));
+            }
+
+            Generic::compactMultiplyAccumulate(re + k, im + k, aRe + k, aIm + k, bRe + k, bIm + k, size - k, gain);
+        }
+
+        // a vector of outputs at a time, with 4 sums over interleaved taps so the adds do not wait on each other
+        __attribute__((target("sse2")))
+        static void fir(float* const output, const float* const input, const float* const taps,
+                        const size_t numTaps, const size_t size, const float gain) noexcept
+        {
+            const __m128 g = _mm_set1_ps(gain);
+            size_t n = 0;
+
+            for (; n + 4 <= size; n += 4)
+            {
+                const float* const in = input + n;
+                __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps(), s2 = _mm_setzero_ps(), s3 = _mm_setzero_ps();
+                size_t k = 0;
+
+                for (; k + 4 <= numTaps; k += 4)
+                {
+                    s0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(taps[k]), _mm_loadu_ps(in + k)), s0);
+                    s1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(taps[k + 1]), _mm_loadu_ps(in + k + 1)), s1);
+                    s2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(taps[k + 2]), _mm_loadu_ps(in + k + 2)), s2);
+                    s3 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(taps[k + 3]), _mm_loadu_ps(in + k + 3)), s3);
+                }
+
+                for (; k < numTaps; ++k)
+                    s0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(taps[k]), _mm_loadu_ps(in + k)), s0);
+
+                const __m128 sum = _mm_add_ps(_mm_add_ps(s0, s1), _mm_add_ps(s2, s3));
+                _mm_storeu_ps(output + n, _mm_add_ps(_mm_mul_ps(sum, g), _mm_loadu_ps(output + n)));
+            }
+
+            Generic::fir(output + n, input + n, taps, numTaps, size - n, gain);
+        }
+    };
+
+    struct AVX2 {
+        __attribute__((target("avx2,fma")))
+        static void multiplyAccumulate(float* const re, float* const im,
+                                       const float* const aRe, const float* const aIm,
+                                       const float* const bRe, const float* const bIm,
+                                       const size_t size) noexcept
+        {
+            size_t k = 0;
+
+            for (; k + 8 <= size; k += 8)
+            {
+                const __m256 ar = _mm256_loadu_ps(aRe + k);
+                const __m256 ai = _mm256_loadu_ps(aIm + k);
+                const __m256 br = _mm256_loadu_ps(bRe + k);
+                const __m256 bi = _mm256_loadu_ps(bIm + k);
+
+                _mm256_storeu_ps(re + k, _mm256_fnmadd_ps(ai, bi, _mm256_fmadd_ps(ar, br, _mm256_loadu_ps(re + k))));
+                _mm256_storeu_ps(im + k, _mm256_fmadd_ps(ai, br, _mm256_fmadd_ps(ar, bi, _mm256_loadu_ps(im + k))));
+            }
+
+            Generic::multiplyAccumulate(re + k, im + k, aRe + k, aIm + k, bRe + k, bIm + k, size - k);
+        }
+
+        __attribute__((target("avx2,fma")))
+        static void compactMultiplyAccumulate(float* const re, float* const im,
+                                              const ConvolutionKernel::CompactSample* const aRe,
+                                              const ConvolutionKernel::CompactSample* const aIm,
+                                              const float* const bRe, const float* const bIm,
+                                              const size_t size, const float gain) noexcept
+        {
+            const __m256 g = _mm256_set1_ps(gain);
+            size_t k = 0;
+
+            for (; k + 8 <= size; k += 8)
+            {
+                const __m128i ar16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aRe + k));
+                const __m128i ai16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aIm + k));
+                const __m256 ar = _mm256_mul_ps(_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(ar16), 16)), g);
+                const __m256 ai = _mm256_mul_ps(_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(ai16), 16)), g);
+                const __m256 br = _mm256_loadu_ps(bRe + k);
+                const __m256 bi = _mm256_loadu_ps(bIm + k);
+
+                _mm256_storeu_ps(re + k, _mm256_fnmadd_ps(ai, bi, _mm256_fmadd_ps(ar, br, _mm256_loadu_ps(re + k))));
+                _mm256_storeu_ps(im + k, _mm256_fmadd_ps(ai, br, _mm256_fmadd_ps(ar, bi, _mm256_loadu_ps(im + k))));
+            }
+
+            Generic::compactMultiplyAccumulate(re + k, im + k, aRe + k, aIm + k, bRe + k, bIm + k, size - k, gain);
+        }
+
+        __attribute__((target("avx2,fma")))
+        static void fir(float* const output, const float* const input, const float* const taps,
+                        const size_t numTaps, const size_t size, const float gain) noexcept
+        {
+            const __m256 g = _mm256_set1_ps(gain);
+            size_t n = 0;
+
+            for (; n + 8 <= size; n += 8)
+            {
+                const float* const in = input + n;
+                __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps(), s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+                size_t k = 0;
+
+                for (; k + 4 <= numTaps; k += 4)
+                {
+                    s0 = _mm256_fmadd_ps(_mm256_set1_ps(taps[k]), _mm256_loadu_ps(in + k), s0);
+                    s1 = _mm256_fmadd_ps(_mm256_set1_ps(taps[k + 1]), _mm256_loadu_ps(in + k + 1), s1);
+                    s2 = _mm256_fmadd_ps(_mm256_set1_ps(taps[k + 2]), _mm256_loadu_ps(in + k + 2), s2);
+                    s3 = _mm256_fmadd_ps(_mm256_set1_ps(taps[k + 3]), _mm256_loadu_ps(in + k + 3), s3);
+                }
+
+                for (; k < numTaps; ++k)
+                    s0 = _mm256_fmadd_ps(_mm256_set1_ps(taps[k]), _mm256_loadu_ps(in + k), s0);
+
+                const __m256 sum = _mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3));
+                _mm256_storeu_ps(output + n, _mm256_fmadd_ps(sum, g, _mm256_loadu_ps(output + n)));
+            }
+
+            Generic::fir(output + n, input + n, taps, numTaps, size - n, gain);
+        }
+    };
+
+    struct AVX512 {
+        __attribute__((target("avx512f")))
+        static void multiplyAccumulate(float* const re, float* const im,
+                                       const float* const aRe, const float* const aIm,
+                                       const float* const bRe, const float* const bIm,
+                                       const size_t size) noexcept
+        {
+            size_t k = 0;
+
+            for (; k + 16 <= size; k += 16)
+            {
+                const __m512 ar = _mm512_loadu_ps(aRe + k);
+                const __m512 ai = _mm512_loadu_ps(aIm + k);
+                const __m512 br = _mm512_loadu_ps(bRe + k);
+                const __m512 bi = _mm512_loadu_ps(bIm + k);
+
+                _mm512_storeu_ps(re + k, _mm512_fnmadd_ps(ai, bi, _mm512_fmadd_ps(ar, br, _mm512_loadu_ps(re + k))));
+                _mm512_storeu_ps(im + k, _mm512_fmadd_ps(ai, br, _mm512_fmadd_ps(ar, bi, _mm512_loadu_ps(im + k))));
+            }
+
+            Generic::multiplyAccumulate(re + k, im + k, aRe + k, aIm + k, bRe + k, bIm + k, size - k);
+        }
+
+        __attribute__((target("avx512f")))
+        static void compactMultiplyAccumulate(float* const re, float* const im,
+                                              const ConvolutionKernel::CompactSample* const aRe,
+                                              const ConvolutionKernel::CompactSample* const aIm,
+                                              const float* const bRe, const float* const bIm,
+                                              const size_t size, const float gain) noexcept
+        {
+            const __m512 g = _mm512_set1_ps(gain);
+            size_t k = 0;
+
+            for (; k + 16 <= size; k += 16)
+            {
+                const __m256i ar16 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(aRe + k));
+                const __m256i ai16 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(aIm + k));
+                const __m512 ar = _mm512_mul_ps(widen(ar16), g);
+                const __m512 ai = _mm512_mul_ps(widen(ai16), g);
+                const __m512 br = _mm512_loadu_ps(bRe + k);
+                const __m512 bi = _mm512_loadu_ps(bIm + k);
+
+                _mm512_storeu_ps(re + k, _mm512_fnmadd_ps(ai, bi, _mm512_fmadd_ps(ar, br, _mm512_loadu_ps(re + k))));
+                _mm512_storeu_ps(im + k, _mm512_fmadd_ps(ai, br, _mm512_fmadd_ps(ar, bi, _mm512_loadu_ps(im + k))));
+            }
+
+            Generic::compactMultiplyAccumulate(re + k, im + k, aRe + k, aIm + k, bRe + k, bIm + k, size - k, gain);
+        }
+
+        __attribute__((target("avx512f")))
+        static void fir(float* const output, const float* const input, const float* const taps,
+                        const size_t numTaps, const size_t size, const float gain) noexcept
+        {
+            const __m512 g = _mm512_set1_ps(gain);
+            size_t n = 0;
+
+            for (; n + 16 <= size; n += 16)
+            {
+                const float* const in = input + n;
+                __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps(), s2 = _mm512_setzero_ps(), s3 = _mm512_setzero_ps();
+                size_t k = 0;
+
+                for (; k + 4 <= numTaps; k += 4)
+                {
+                    s0 = _mm512_fmadd_ps(_mm512_set1_ps(taps[k]), _mm512_loadu_ps(in + k), s0);
+                    s1 = _mm512_fmadd_ps(_mm512_set1_ps(taps[k + 1]), _mm512_loadu_ps(in + k + 1), s1);
+                    s2 = _mm512_fmadd_ps(_mm512_set1_ps(taps[k + 2]), _mm512_loadu_ps(in + k + 2), s2);
+                    s3 = _mm512_fmadd_ps(_mm512_set1_ps(taps[k + 3]), _mm512_loadu_ps(in + k + 3), s3);
+                }
+
+                for (; k < numTaps; ++k)
+                    s0 = _mm512_fmadd_ps(_mm512_set1_ps(taps[k]), _mm512_loadu_ps(in + k), s0);
+
+                const __m512 sum = _mm512_add_ps(_mm512_add_ps(s0, s1), _mm512_add_ps(s2, s3));
+                _mm512_storeu_ps(output + n, _mm512_fmadd_ps(sum, g, _mm512_loadu_ps(output + n)));
+            }
+
+            Generic::fir(output + n, input + n, taps, numTaps, size - n, gain);
+        }
+
+        // the masked forms, as the regular ones trip a false -Wmaybe-uninitialized on GCC 12
+        __attribute__((target("avx512f")))
+        static __m512 widen(const __m256i values) noexcept
+        {
+            return _mm512_castsi512_ps(_mm512_maskz_slli_epi32(0xffff, _mm512_maskz_cvtepu16_epi32(0xffff, values), 16));
+        }
+    };
+   #endif
+
+    DISTRHO_DECLARE_NON_COPYABLE(ConvolutionSIMD)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
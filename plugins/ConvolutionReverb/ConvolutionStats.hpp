@@ -0,0 +1,244 @@
+/*
+ * Convolution Stats
+ * Copyright (C) 2022-2023 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: ISC
+ */
+
+#pragma once
+
+#include "DistrhoUtils.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// Timing of background convolution jobs, and of the audio thread waiting on them,
+// together with how much trimming saved on the last IR loaded.
+//
+// Written lock-free by the workers, the loader and the audio thread, can live in memory shared with the UI.
+// Durations are in microseconds, histograms group them by powers of 2:
+// bucket 0 is anything under 16us, bucket N covers [8us << N, 16us << N), the last bucket everything above.
+
+struct ConvolutionStats {
+    static constexpr const uint kNumBuckets = 12;
+
+    // jobs run, and how many of those finished after their deadline
+    std::atomic<uint32_t> numJobs;
+    std::atomic<uint32_t> numLateJobs;
+    std::atomic<uint32_t> maxJobTime;
+    std::atomic<uint32_t> jobTimes[kNumBuckets];
+
+    // blocks where the audio thread needed a job that was not finished yet, and had to wait for it or run it itself
+    std::atomic<uint32_t> numWaits;
+    std::atomic<uint32_t> maxWaitTime;
+    std::atomic<uint32_t> waitTimes[kNumBuckets];
+
+    // IRs loaded so far, increased after the values below are set for the last one.
+    // delay and lengths are in samples, partitions are those left after trimming, those before it,
+    // and how many of the ones left are not silent.
+    std::atomic<uint32_t> numLoads;
+    std::atomic<uint32_t> irDelay;
+    std::atomic<uint32_t> irLength;
+    std::atomic<uint32_t> irUntrimmedLength;
+    std::atomic<uint32_t> irPartitions;
+    std::atomic<uint32_t> irUntrimmedPartitions;
+    std::atomic<uint32_t> irActivePartitions;
+
+    // the same for the IR being morphed into, all 0 if none. its delay is replaced by the 1st IR's
+    std::atomic<uint32_t> morphLength;
+    std::atomic<uint32_t> morphUntrimmedLength;
+    std::atomic<uint32_t> morphActivePartitions;
+
+    // low, mid and high band decay times of the algorithmic tail, in milliseconds, all 0 if none
+    std::atomic<uint32_t> tailDecayTimes[3];
+
+    void reset() noexcept
+    {
+        numJobs.store(0, std::memory_order_relaxed);
+        numLateJobs.store(0, std::memory_order_relaxed);
+        maxJobTime.store(0, std::memory_order_relaxed);
+        numWaits.store(0, std::memory_order_relaxed);
+        maxWaitTime.store(0, std::memory_order_relaxed);
+
+        for (uint i = 0; i < kNumBuckets; ++i)
+        {
+            jobTimes[i].store(0, std::memory_order_relaxed);
+            waitTimes[i].store(0, std::memory_order_relaxed);
+        }
+
+        numLoads.store(0, std::memory_order_relaxed);
+        irDelay.store(0, std::memory_order_relaxed);
+        irLength.store(0, std::memory_order_relaxed);
+        irUntrimmedLength.store(0, std::memory_order_relaxed);
+        irPartitions.store(0, std::memory_order_relaxed);
+        irUntrimmedPartitions.store(0, std::memory_order_relaxed);
+        irActivePartitions.store(0, std::memory_order_relaxed);
+        morphLength.store(0, std::memory_order_relaxed);
+        morphUntrimmedLength.store(0, std::memory_order_relaxed);
+        morphActivePartitions.store(0, std::memory_order_relaxed);
+
+        for (uint i = 0; i < 3; ++i)
+            tailDecayTimes[i].store(0, std::memory_order_relaxed);
+    }
+
+    void copyFrom(const ConvolutionStats& other) noexcept
+    {
+        numJobs.store(other.numJobs.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        numLateJobs.store(other.numLateJobs.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        maxJobTime.store(other.maxJobTime.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        numWaits.store(other.numWaits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        maxWaitTime.store(other.maxWaitTime.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+        for (uint i = 0; i < kNumBuckets; ++i)
+        {
+            jobTimes[i].store(other.jobTimes[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            waitTimes[i].store(other.waitTimes[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+
+        // only changes on loads, no need to copy it all every time
+        const uint32_t loads = other.numLoads.load(std::memory_order_acquire);
+
+        if (numLoads.load(std::memory_order_relaxed) == loads)
+            return;
+
+        irDelay.store(other.irDelay.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        irLength.store(other.irLength.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        irUntrimmedLength.store(other.irUntrimmedLength.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        irPartitions.store(other.irPartitions.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        irUntrimmedPartitions.store(other.irUntrimmedPartitions.load(std::memory_order_relaxed),
+                                    std::memory_order_relaxed);
+        irActivePartitions.store(other.irActivePartitions.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        morphLength.store(other.morphLength.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        morphUntrimmedLength.store(other.morphUntrimmedLength.load(std::memory_order_relaxed),
+                                   std::memory_order_relaxed);
+        morphActivePartitions.store(other.morphActivePartitions.load(std::memory_order_relaxed),
+                                    std::memory_order_relaxed);
+
+        for (uint i = 0; i < 3; ++i)
+            tailDecayTimes[i].store(other.tailDecayTimes[i].load(std::memory_order_relaxed),
+                                    std::memory_order_relaxed);
+
+        numLoads.store(loads, std::memory_order_release);
+    }
+
+    void addJob(const uint64_t durationNs, const bool late) noexcept
+    {
+        numJobs.fetch_add(1, std::memory_order_relaxed);
+
+        if (late)
+            numLateJobs.fetch_add(1, std::memory_order_relaxed);
+
+        add(durationNs, maxJobTime, jobTimes);
+    }
+
+    void addWait(const uint64_t durationNs) noexcept
+    {
+        numWaits.fetch_add(1, std::memory_order_relaxed);
+        add(durationNs, maxWaitTime, waitTimes);
+    }
+
+    // a single line of text, for reporting through plugin state
+    void format(char* const buffer, const size_t size) const noexcept
+    {
+        int pos = std::snprintf(buffer, size, "jobs=%u late=%u maxjob=%uus waits=%u maxwait=%uus",
+                                numJobs.load(std::memory_order_relaxed),
+                                numLateJobs.load(std::memory_order_relaxed),
+                                maxJobTime.load(std::memory_order_relaxed),
+                                numWaits.load(std::memory_order_relaxed),
+                                maxWaitTime.load(std::memory_order_relaxed));
+
+        pos += formatHistogram(buffer, size, pos, " jobhist=", jobTimes);
+        formatHistogram(buffer, size, pos, " waithist=", waitTimes);
+    }
+
+    // a single line of text about the last IR loaded, empty if none yet, for reporting through plugin state
+    void formatLoad(char* const buffer, const size_t size) const noexcept
+    {
+        if (numLoads.load(std::memory_order_acquire) == 0)
+        {
+            buffer[0] = '\0';
+            return;
+        }
+
+        int pos = std::snprintf(buffer, size, "delay=%u length=%u/%u partitions=%u/%u active=%u",
+                                irDelay.load(std::memory_order_relaxed),
+                                irLength.load(std::memory_order_relaxed),
+                                irUntrimmedLength.load(std::memory_order_relaxed),
+                                irPartitions.load(std::memory_order_relaxed),
+                                irUntrimmedPartitions.load(std::memory_order_relaxed),
+                                irActivePartitions.load(std::memory_order_relaxed));
+
+        if (tailDecayTimes[0].load(std::memory_order_relaxed) != 0 && pos >= 0 && static_cast<size_t>(pos) < size)
+            pos += std::snprintf(buffer + pos, size - pos, " tail=%u/%u/%ums",
+                                 tailDecayTimes[0].load(std::memory_order_relaxed),
+                                 tailDecayTimes[1].load(std::memory_order_relaxed),
+                                 tailDecayTimes[2].load(std::memory_order_relaxed));
+
+        if (morphLength.load(std::memory_order_relaxed) != 0 && pos >= 0 && static_cast<size_t>(pos) < size)
+            std::snprintf(buffer + pos, size - pos, " morph=%u/%u active=%u",
+                          morphLength.load(std::memory_order_relaxed),
+                          morphUntrimmedLength.load(std::memory_order_relaxed),
+                          morphActivePartitions.load(std::memory_order_relaxed));
+    }
+
+    // upper bound of the bucket holding the `fraction` percentile of `times`, in microseconds.
+    // UINT32_MAX if it lands in the last bucket, 0 if nothing was recorded yet.
+    static uint32_t getPercentile(const std::atomic<uint32_t> times[kNumBuckets], const double fraction) noexcept
+    {
+        uint64_t total = 0;
+        for (uint i = 0; i < kNumBuckets; ++i)
+            total += times[i].load(std::memory_order_relaxed);
+
+        if (total == 0)
+            return 0;
+
+        const uint64_t target = static_cast<uint64_t>(total * fraction + 0.5);
+        uint64_t count = 0;
+
+        for (uint i = 0; i + 1 < kNumBuckets; ++i)
+        {
+            count += times[i].load(std::memory_order_relaxed);
+
+            if (count >= target)
+                return 16U << i;
+        }
+
+        return UINT32_MAX;
+    }
+
+private:
+    static void add(const uint64_t durationNs, std::atomic<uint32_t>& maxTime, std::atomic<uint32_t> times[kNumBuckets]) noexcept
+    {
+        const uint32_t us = static_cast<uint32_t>(std::min<uint64_t>(durationNs / 1000, UINT32_MAX));
+
+        uint bucket = 0;
+        for (uint32_t t = us >> 4; t != 0 && bucket + 1 < kNumBuckets; t >>= 1)
+            ++bucket;
+
+        times[bucket].fetch_add(1, std::memory_order_relaxed);
+
+        uint32_t prev = maxTime.load(std::memory_order_relaxed);
+        while (prev < us && ! maxTime.compare_exchange_weak(prev, us, std::memory_order_relaxed)) {}
+    }
+
+    static int formatHistogram(char* const buffer, const size_t size, const int pos, const char* const label,
+                               const std::atomic<uint32_t> times[kNumBuckets]) noexcept
+    {
+        if (pos < 0 || static_cast<size_t>(pos) >= size)
+            return 0;
+
+        int written = std::snprintf(buffer + pos, size - pos, "%s", label);
+
+        for (uint i = 0; i < kNumBuckets && pos + written >= 0 && static_cast<size_t>(pos + written) < size; ++i)
+            written += std::snprintf(buffer + pos + written, size - pos - written, i == 0 ? "%u" : ",%u",
+                                     times[i].load(std::memory_order_relaxed));
+
+        return written;
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
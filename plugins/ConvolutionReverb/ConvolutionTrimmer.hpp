@@ -0,0 +1,206 @@
+/*
+ * Convolution IR Trimmer
+ * Copyright (C) 2022-2023 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: ISC
+ */
+
+#pragma once
+
+#include "DistrhoUtils.hpp"
+
+#include <cmath>
+#include <vector>
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// How much of an IR is considered inaudible and can be trimmed away.
+
+struct ConvolutionTrimSettings {
+    // level relative to the peak under which leading samples are considered silence, in dB
+    float onsetThreshold;
+    // level of the energy decay curve relative to the total energy under which the tail is cut, in dB
+    float tailFloor;
+    // length of the fade out applied after the tail cut point, in ms
+    float fadeLength;
+    // longest IR kept after the onset, in ms, 0 for no limit
+    float maxLength;
+
+    ConvolutionTrimSettings() noexcept
+        : onsetThreshold(-60.f),
+          tailFloor(-100.f),
+          fadeLength(10.f),
+          maxLength(0.f) {}
+
+    bool operator==(const ConvolutionTrimSettings& other) const noexcept
+    {
+        return d_isEqual(onsetThreshold, other.onsetThreshold) &&
+               d_isEqual(tailFloor, other.tailFloor) &&
+               d_isEqual(fadeLength, other.fadeLength) &&
+               d_isEqual(maxLength, other.maxLength);
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// Finds the audible region of an IR, fed in chunks while it is being decoded.
+//
+// All channels of a file are analyzed together so they stay aligned, and get the same region.
+// The start becomes an integer delay in the convolver instead of partitions full of zeros,
+// the end is where the Schroeder energy decay curve of all channels falls under the floor, plus the fade.
+// A maximum length can cut it earlier, for when the rest of the IR is left to a ConvolutionLateTail.
+//
+// Only the peak level and energy of every block of frames is kept, so memory use stays small for any IR length.
+// The region is found with block precision, always rounded towards keeping more of the IR.
+
+class ConvolutionTrimmer
+{
+public:
+    struct Region {
+        size_t start;
+        size_t end;
+        size_t fadeStart;
+    };
+
+    // a bit of time kept before the onset, so the resampler pre-ringing is not cut
+    static constexpr const double kOnsetMargin = 0.001;
+
+    static constexpr const size_t kBlockSize = 64;
+
+    ConvolutionTrimmer()
+        : numFrames(0),
+          blockPeak(0.f),
+          blockEnergy(0.0) {}
+
+    // `numFramesHint` is only used for reserving memory upfront
+    void reset(const size_t numFramesHint = 0)
+    {
+        numFrames = 0;
+        blockPeak = 0.f;
+        blockEnergy = 0.0;
+        blockPeaks.clear();
+        blockEnergies.clear();
+        blockPeaks.reserve(numFramesHint / kBlockSize + 1);
+        blockEnergies.reserve(numFramesHint / kBlockSize + 1);
+    }
+
+    // analyze the first `numChannels` of `frames` interleaved frames with `numFileChannels` each
+    void process(const float* const interleaved, const uint numFileChannels, const uint numChannels,
+                 const size_t frames)
+    {
+        for (size_t i = 0; i < frames; ++i)
+        {
+            for (uint c = 0; c < numChannels; ++c)
+            {
+                const float value = interleaved[i * numFileChannels + c];
+                blockPeak = std::max(blockPeak, std::abs(value));
+                blockEnergy += static_cast<double>(value) * value;
+            }
+
+            if (++numFrames % kBlockSize == 0)
+                finishBlock();
+        }
+    }
+
+    Region analyze(const double sampleRate, const ConvolutionTrimSettings& settings)
+    {
+        if (numFrames % kBlockSize != 0)
+            finishBlock();
+
+        Region region = { 0, numFrames, numFrames };
+
+        float peak = 0.f;
+        for (const float blockPeakValue : blockPeaks)
+            peak = std::max(peak, blockPeakValue);
+
+        // nothing we can do with silence
+        if (peak <= 0.f)
+            return region;
+
+        // onset, first block of any channel above threshold
+        const float onsetLevel = peak * std::pow(10.f, 0.05f * settings.onsetThreshold);
+        size_t onsetBlock = 0;
+
+        while (blockPeaks[onsetBlock] < onsetLevel)
+            ++onsetBlock;
+
+        const size_t onset = onsetBlock * kBlockSize;
+        const size_t margin = static_cast<size_t>(kOnsetMargin * sampleRate + 0.5);
+        region.start = onset > margin ? onset - margin : 0;
+
+        // tail, last block where the remaining energy is still above the floor
+        double totalEnergy = 0.0;
+        for (size_t b = onsetBlock; b < blockEnergies.size(); ++b)
+            totalEnergy += blockEnergies[b];
+
+        const double floorEnergy = totalEnergy * std::pow(10.0, 0.1 * settings.tailFloor);
+        double remainingEnergy = 0.0;
+        size_t tailEnd = numFrames;
+
+        for (size_t b = blockEnergies.size(); b-- > onsetBlock;)
+        {
+            remainingEnergy += blockEnergies[b];
+
+            if (remainingEnergy > floorEnergy)
+            {
+                tailEnd = std::min(numFrames, (b + 1) * kBlockSize);
+                break;
+            }
+        }
+
+        if (settings.maxLength > 0.f)
+            tailEnd = std::min(tailEnd, onset + static_cast<size_t>(settings.maxLength * 0.001 * sampleRate + 0.5));
+
+        const size_t fadeFrames = static_cast<size_t>(settings.fadeLength * 0.001 * sampleRate + 0.5);
+
+        region.fadeStart = tailEnd;
+        region.end = std::min(numFrames, tailEnd + fadeFrames);
+        return region;
+    }
+
+    // scale a region found at one sample rate into another
+    static Region scale(const Region& region, const size_t numFrames, const double ratio)
+    {
+        Region scaled;
+        scaled.end = std::min(numFrames, static_cast<size_t>(std::ceil(region.end * ratio)));
+        scaled.fadeStart = std::min(scaled.end, static_cast<size_t>(std::ceil(region.fadeStart * ratio)));
+        scaled.start = std::min(scaled.fadeStart, static_cast<size_t>(region.start * ratio));
+        return scaled;
+    }
+
+    // raised cosine fade out between the region fade start and end,
+    // on a buffer holding `length` samples of the IR starting at `offset`
+    static void applyFadeOut(float* const buffer, const size_t offset, const size_t length, const Region& region)
+    {
+        const size_t fadeFrames = region.end - region.fadeStart;
+        const size_t first = std::max(offset, region.fadeStart);
+        const size_t last = std::min(offset + length, region.end);
+
+        for (size_t i = first; i < last; ++i)
+        {
+            const size_t fadePos = i - region.fadeStart;
+            const float gain = 0.5f + 0.5f * std::cos(static_cast<float>(M_PI) * (fadePos + 1) / (fadeFrames + 1));
+            buffer[i - offset] *= gain;
+        }
+    }
+
+private:
+    size_t numFrames;
+    float blockPeak;
+    double blockEnergy;
+    std::vector<float> blockPeaks;
+    std::vector<double> blockEnergies;
+
+    void finishBlock()
+    {
+        blockPeaks.push_back(blockPeak);
+        blockEnergies.push_back(blockEnergy);
+        blockPeak = 0.f;
+        blockEnergy = 0.0;
+    }
+
+    DISTRHO_DECLARE_NON_COPYABLE(ConvolutionTrimmer)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
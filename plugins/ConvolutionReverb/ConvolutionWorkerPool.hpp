@@ -0,0 +1,383 @@
+/*
+ * Convolution Worker Pool
+ * Copyright (C) 2022-2023 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: ISC
+ */
+
+#pragma once
+
+#include "Semaphore.hpp"
+#include "extra/Mutex.hpp"
+#include "extra/ScopedPointer.hpp"
+#include "extra/Thread.hpp"
+
+#ifdef DISTRHO_OS_WINDOWS
+# ifndef WIN32_LEAN_AND_MEAN
+#  define WIN32_LEAN_AND_MEAN
+# endif
+# include <winsock2.h>
+# include <windows.h>
+#else
+# include <time.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// Process-wide pool of worker threads running background convolution jobs for all plugin instances.
+//
+// Each worker keeps its own small queue and picks the job with the earliest deadline from it,
+// idle workers steal from the other queues.
+// A job that has not been picked up yet when its owner needs the result is run directly by the owner instead.
+
+class ConvolutionWorkerPool
+{
+    static constexpr const uint kMaxWorkers = 32;
+    static constexpr const uint kQueueSize = 256;
+
+    enum JobState {
+        kJobIdle,
+        kJobQueued,
+        kJobRunning,
+        kJobDone
+    };
+
+public:
+    class Job
+    {
+    public:
+        Job()
+            : state(kJobIdle),
+              deadline(0),
+              preferredWorker(~0U),
+              semFinished(0) {}
+
+        virtual ~Job() {}
+
+    protected:
+        virtual void runJob() = 0;
+
+    private:
+        friend class ConvolutionWorkerPool;
+        std::atomic<int> state;
+        uint64_t deadline;
+        uint preferredWorker;
+        Semaphore semFinished;
+
+        DISTRHO_DECLARE_NON_COPYABLE(Job)
+    };
+
+    // keeps the process-wide pool alive while in use
+    struct SharedInstance {
+        SharedInstance()
+            : pool(acquire()) {}
+
+        ~SharedInstance()
+        {
+            release();
+        }
+
+        ConvolutionWorkerPool* operator->() const noexcept
+        {
+            return pool;
+        }
+
+        ConvolutionWorkerPool* const pool;
+
+        DISTRHO_DECLARE_NON_COPYABLE(SharedInstance)
+    };
+
+    static uint64_t getTimeNs() noexcept
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // CPU time used by the calling thread so far, not affected by other threads or processes
+    static uint64_t getThreadTimeNs() noexcept
+    {
+       #ifdef DISTRHO_OS_WINDOWS
+        FILETIME creation, exit, kernel, user;
+        if (! ::GetThreadTimes(::GetCurrentThread(), &creation, &exit, &kernel, &user))
+            return getTimeNs();
+
+        // in 100ns units
+        return ((static_cast<uint64_t>(kernel.dwHighDateTime) << 32 | kernel.dwLowDateTime)
+              + (static_cast<uint64_t>(user.dwHighDateTime) << 32 | user.dwLowDateTime)) * 100;
+       #else
+        struct timespec ts;
+        if (::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+            return getTimeNs();
+
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+       #endif
+    }
+
+    uint getNumWorkers() const noexcept
+    {
+        return numWorkers;
+    }
+
+    // queue a job, which must be completed within `deadlineNs` from now
+    void submitJob(Job* const job, const uint64_t deadlineNs)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(job->state.load() == kJobIdle,);
+
+        if (job->preferredWorker >= numWorkers)
+            job->preferredWorker = nextWorker.fetch_add(1) % numWorkers;
+
+        Worker* const worker = workers[job->preferredWorker].get();
+
+        const uint64_t deadline = getTimeNs() + deadlineNs;
+
+        {
+            const SpinLocker sl(worker->queueLock);
+
+            if (worker->queueCount < kQueueSize)
+            {
+                job->deadline = deadline;
+                job->state.store(kJobQueued);
+                worker->queue[worker->queueCount++] = job;
+                semWorkAvailable.post();
+                return;
+            }
+        }
+
+        // queue is full, not much we can do besides running the job ourselves
+        job->runJob();
+    }
+
+    // wait for a previously submitted job to finish, running it in the calling thread if not started yet
+    void waitForJob(Job* const job)
+    {
+        int expected = kJobQueued;
+
+        if (job->state.compare_exchange_strong(expected, kJobRunning))
+        {
+            // so the stale entry does not take up room in the queue, or outlive the job
+            removeFromQueue(job);
+            job->runJob();
+            job->state.store(kJobIdle);
+            return;
+        }
+
+        if (expected == kJobIdle)
+            return;
+
+        job->semFinished.wait();
+        job->state.store(kJobIdle);
+    }
+
+    // whether a job is done running, or was never submitted, without waiting for it
+    bool isJobFinished(const Job* const job) const noexcept
+    {
+        const int state = job->state.load();
+        return state == kJobDone || state == kJobIdle;
+    }
+
+    // remove any references to a job from the queues, must be called before the job is deleted
+    void cancelJob(Job* const job)
+    {
+        removeFromQueue(job);
+
+        int expected = kJobQueued;
+
+        if (job->state.compare_exchange_strong(expected, kJobIdle))
+            return;
+
+        if (expected != kJobIdle)
+        {
+            job->semFinished.wait();
+            job->state.store(kJobIdle);
+        }
+    }
+
+private:
+    struct SpinLock {
+        std::atomic_flag flag = ATOMIC_FLAG_INIT;
+    };
+
+    struct SpinLocker {
+        SpinLocker(SpinLock& l) noexcept
+            : lock(l)
+        {
+            while (lock.flag.test_and_set(std::memory_order_acquire))
+                std::this_thread::yield();
+        }
+
+        ~SpinLocker() noexcept
+        {
+            lock.flag.clear(std::memory_order_release);
+        }
+
+        SpinLock& lock;
+    };
+
+    struct Worker : Thread {
+        ConvolutionWorkerPool& pool;
+        const uint index;
+
+        SpinLock queueLock;
+        Job* queue[kQueueSize];
+        uint queueCount;
+
+        Worker(ConvolutionWorkerPool& p, const uint i)
+            : Thread("ConvolutionWorker"),
+              pool(p),
+              index(i),
+              queueCount(0) {}
+
+        void run() override
+        {
+            while (!shouldThreadExit())
+            {
+                pool.semWorkAvailable.wait();
+
+                if (shouldThreadExit())
+                    break;
+
+                while (Job* const job = pool.takeJob(index))
+                {
+                    job->runJob();
+                    job->state.store(kJobDone);
+                    job->semFinished.post();
+                }
+            }
+        }
+
+        DISTRHO_DECLARE_NON_COPYABLE(Worker)
+    };
+
+    ScopedPointer<Worker> workers[kMaxWorkers];
+    uint numWorkers;
+    std::atomic<uint> nextWorker;
+    Semaphore semWorkAvailable;
+
+    ConvolutionWorkerPool()
+        : numWorkers(std::max(1U, std::min(kMaxWorkers, std::thread::hardware_concurrency()))),
+          nextWorker(0),
+          semWorkAvailable(0)
+    {
+        for (uint w = 0; w < numWorkers; ++w)
+        {
+            workers[w] = new Worker(*this, w);
+            workers[w]->startThread(true);
+        }
+    }
+
+    ~ConvolutionWorkerPool()
+    {
+        for (uint w = 0; w < numWorkers; ++w)
+            workers[w]->signalThreadShouldExit();
+
+        for (uint w = 0; w < numWorkers; ++w)
+            semWorkAvailable.post();
+
+        for (uint w = 0; w < numWorkers; ++w)
+            workers[w]->stopThread(5000);
+    }
+
+    // take the most urgent job from our own queue, or steal one from the other workers if empty
+    Job* takeJob(const uint index)
+    {
+        for (uint w = 0; w < numWorkers; ++w)
+        {
+            if (Job* const job = takeJobFrom(workers[(index + w) % numWorkers].get()))
+                return job;
+        }
+
+        return nullptr;
+    }
+
+    // jobs are only ever queued on their preferred worker, others just take them out
+    void removeFromQueue(Job* const job)
+    {
+        if (job->preferredWorker >= numWorkers)
+            return;
+
+        Worker* const worker = workers[job->preferredWorker].get();
+        const SpinLocker sl(worker->queueLock);
+
+        for (uint i = 0; i < worker->queueCount;)
+        {
+            if (worker->queue[i] == job)
+                worker->queue[i] = worker->queue[--worker->queueCount];
+            else
+                ++i;
+        }
+    }
+
+    Job* takeJobFrom(Worker* const worker)
+    {
+        const SpinLocker sl(worker->queueLock);
+
+        while (worker->queueCount != 0)
+        {
+            uint best = 0;
+            for (uint i = 1; i < worker->queueCount; ++i)
+            {
+                if (worker->queue[i]->deadline < worker->queue[best]->deadline)
+                    best = i;
+            }
+
+            Job* const job = worker->queue[best];
+            worker->queue[best] = worker->queue[--worker->queueCount];
+
+            // the job might have been taken over by its owner in the mean time
+            int expected = kJobQueued;
+            if (job->state.compare_exchange_strong(expected, kJobRunning))
+                return job;
+        }
+
+        return nullptr;
+    }
+
+    static Mutex& getSharedMutex()
+    {
+        static Mutex mutex;
+        return mutex;
+    }
+
+    static ConvolutionWorkerPool*& getSharedPool()
+    {
+        static ConvolutionWorkerPool* pool = nullptr;
+        return pool;
+    }
+
+    static uint& getSharedCount()
+    {
+        static uint count = 0;
+        return count;
+    }
+
+    static ConvolutionWorkerPool* acquire()
+    {
+        const MutexLocker cml(getSharedMutex());
+
+        if (getSharedCount()++ == 0)
+            getSharedPool() = new ConvolutionWorkerPool();
+
+        return getSharedPool();
+    }
+
+    static void release()
+    {
+        const MutexLocker cml(getSharedMutex());
+
+        if (--getSharedCount() == 0)
+        {
+            delete getSharedPool();
+            getSharedPool() = nullptr;
+        }
+    }
+
+    DISTRHO_DECLARE_NON_COPYABLE(ConvolutionWorkerPool)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
@@ -16,6 +16,11 @@
 
 #pragma once
 
+#include "ConvolutionStats.hpp"
+
+// background job timing, also shared with the UI
+#define ONEKNOB_SHARED_STATS_TYPE ConvolutionStats
+
 #include "OneKnobPluginInfo.h"
 
 #define DISTRHO_PLUGIN_NAME    "OneKnob Convolution Loader"
@@ -29,12 +34,25 @@
 #undef DISTRHO_PLUGIN_IS_RT_SAFE
 #define DISTRHO_PLUGIN_IS_RT_SAFE 0
 
+#define DISTRHO_PLUGIN_WANT_LATENCY 1
+
+// reports are read-only states, formatted when the host asks for them
+#undef DISTRHO_PLUGIN_WANT_FULL_STATE
+#define DISTRHO_PLUGIN_WANT_FULL_STATE 1
+
 enum Parameters {
     kParameterDryLevel,
     kParameterWetLevel,
     kParameterHighPassFilter,
     kParameterTrails,
     kParameterBypass,
+    kParameterEfficientMode,
+    kParameterLength,
+    kParameterPreDelay,
+    kParameterCompactKernels,
+    kParameterLateTail,
+    kParameterMorph,
+    kParameterLoadProgress,
     kParameterCount
 };
 
@@ -45,6 +63,9 @@ enum Programs {
 
 enum States {
     kStateFile,
+    kStateMorphFile,
+    kStateTrimReport,
+    kStateStats,
     kStateCount
 };
 
@@ -55,5 +76,12 @@ static constexpr const struct OneKnobParameterRanges {
     { -60.f, -30.f, 0.f },
     { 0.f, 0.f, 500.f },
     { 0.f, 1.f, 1.f },
-    { 0.f, 0.f, 1.f }
+    { 0.f, 0.f, 1.f },
+    { 0.f, 0.f, 1.f },
+    { 5.f, 100.f, 100.f },
+    { 0.f, 0.f, 250.f },
+    { 0.f, 0.f, 1.f },
+    { 0.f, 0.f, 1.f },
+    { 0.f, 0.f, 100.f },
+    { 0.f, 100.f, 100.f }
 };
@@ -0,0 +1,143 @@
+/*
+ * Joint Stereo FFT
+ * Copyright (C) 2022-2023 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: ISC
+ */
+
+#pragma once
+
+#include "DistrhoUtils.hpp"
+
+#include "r8brain/pffft.h"
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// Transforms 2 real signals with a single complex FFT, by packing them as its real and imaginary parts.
+//
+// Spectra use the same split half-spectrum layout and scaling as audiofft::AudioFFT,
+// so they can be freely mixed with spectra coming from it (e.g. IR kernels).
+
+class JointStereoFFT
+{
+public:
+    JointStereoFFT()
+        : size(0),
+          setup(nullptr),
+          packed(nullptr),
+          transformed(nullptr),
+          work(nullptr) {}
+
+    ~JointStereoFFT()
+    {
+        clear();
+    }
+
+    // `newSize` is the size of each real signal, must be a power of 2 and at least 16
+    void init(const size_t newSize)
+    {
+        clear();
+
+        setup = pffft_new_setup(static_cast<int>(newSize), PFFFT_COMPLEX);
+        DISTRHO_SAFE_ASSERT_RETURN(setup != nullptr,);
+
+        size = newSize;
+        packed = static_cast<float*>(pffft_aligned_malloc(sizeof(float) * newSize * 2));
+        transformed = static_cast<float*>(pffft_aligned_malloc(sizeof(float) * newSize * 2));
+        work = static_cast<float*>(pffft_aligned_malloc(sizeof(float) * newSize * 2));
+    }
+
+    // forward transform of 2 real signals with `length` samples each, zero-padded up to the FFT size.
+    // outputs `size / 2 + 1` complex bins per signal.
+    void fft(const float* const inL, const float* const inR, const size_t length,
+             float* const reL, float* const imL, float* const reR, float* const imR)
+    {
+        for (size_t i = 0; i < length; ++i)
+        {
+            packed[i * 2 + 0] = inL[i];
+            packed[i * 2 + 1] = inR[i];
+        }
+
+        std::memset(packed + length * 2, 0, sizeof(float) * (size - length) * 2);
+
+        pffft_transform_ordered(setup, packed, transformed, work, PFFFT_FORWARD);
+
+        // L[k] = (Z[k] + conj(Z[N-k])) / 2
+        // R[k] = (Z[k] - conj(Z[N-k])) / 2j
+        for (size_t k = 0, half = size / 2; k <= half; ++k)
+        {
+            const size_t mirror = k != 0 ? size - k : 0;
+            const float a = transformed[k * 2 + 0];
+            const float b = transformed[k * 2 + 1];
+            const float c = transformed[mirror * 2 + 0];
+            const float d = transformed[mirror * 2 + 1];
+
+            reL[k] = 0.5f * (a + c);
+            imL[k] = 0.5f * (b - d);
+            reR[k] = 0.5f * (b + d);
+            imR[k] = 0.5f * (c - a);
+        }
+    }
+
+    // inverse transform of 2 half spectra into 2 real signals of the full FFT size, scaled by 1/size
+    void ifft(float* const outL, float* const outR,
+              const float* const reL, const float* const imL, const float* const reR, const float* const imR)
+    {
+        const float scale = 1.f / static_cast<float>(size);
+
+        // Z[k] = L[k] + j R[k], with the upper half rebuilt from the conjugate symmetry of L and R
+        for (size_t k = 0, half = size / 2; k <= half; ++k)
+        {
+            const float p = reL[k] * scale;
+            const float q = imL[k] * scale;
+            const float r = reR[k] * scale;
+            const float s = imR[k] * scale;
+
+            packed[k * 2 + 0] = p - s;
+            packed[k * 2 + 1] = q + r;
+
+            if (k != 0 && k != half)
+            {
+                const size_t mirror = size - k;
+                packed[mirror * 2 + 0] = p + s;
+                packed[mirror * 2 + 1] = r - q;
+            }
+        }
+
+        pffft_transform_ordered(setup, packed, transformed, work, PFFFT_BACKWARD);
+
+        for (size_t i = 0; i < size; ++i)
+        {
+            outL[i] = transformed[i * 2 + 0];
+            outR[i] = transformed[i * 2 + 1];
+        }
+    }
+
+private:
+    size_t size;
+    PFFFT_Setup* setup;
+    float* packed;
+    float* transformed;
+    float* work;
+
+    void clear()
+    {
+        if (setup != nullptr)
+        {
+            pffft_destroy_setup(setup);
+            setup = nullptr;
+        }
+
+        pffft_aligned_free(packed);
+        pffft_aligned_free(transformed);
+        pffft_aligned_free(work);
+        packed = transformed = work = nullptr;
+        size = 0;
+    }
+
+    DISTRHO_DECLARE_NON_COPYABLE(JointStereoFFT)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
@@ -0,0 +1,1552 @@
+/*
+ * Multi-Stage Threaded Convolver
+ * Copyright (C) 2022-2023 Filipe Coelho <falktx@falktx.com>
+ * SPDX-License-Identifier: ISC
+ */
+
+#pragma once
+
+#ifndef DISTRHO_OS_WASM
+# include "ConvolutionStats.hpp"
+# include "ConvolutionWorkerPool.hpp"
+#endif
+
+#include "ConvolutionKernel.hpp"
+#include "ConvolutionSIMD.hpp"
+#include "JointStereoFFT.hpp"
+#include "extra/ScopedPointer.hpp"
+
+START_NAMESPACE_DISTRHO
+
+// --------------------------------------------------------------------------------------------------------------------
+// Non-uniform partitioned convolver, with partition sizes growing geometrically per stage.
+//
+// The head stage runs on the calling (audio) thread with zero latency, every later stage runs as a job in the
+// shared ConvolutionWorkerPool.
+// Stage N uses blocks of `headBlockSize * stageGrowthFactor^N` samples and starts at an IR offset of 2 blocks,
+// which leaves it exactly 1 block worth of time to complete its work before the result is needed.
+//
+// With the default layout:
+//   stage 0: 128 block,   IR [0, 2048)        (audio thread)
+//   stage 1: 1024 block,  IR [2048, 16384)    (background)
+//   stage 2: 8192 block,  IR [16384, 131072)  (background)
+//   stage 3: 65536 block, IR [131072, ...)    (background)
+//
+// When the host buffer size does not line up with the head blocks, the head stage would have to transform
+// its partial block on every call. Instead its 1st partition is then done as a direct-form FIR,
+// and the remaining head partitions only once per complete block.
+//
+// The partitioned IR spectra live in a ConvolutionKernel which can be shared with other convolvers,
+// only the input spectra and overlap are kept per convolver.
+//
+// Up to 2 inputs and 2 outputs can be convolved through a matrix of kernels (L/R for regular stereo IRs,
+// LL/LR/RL/RR for true stereo ones), with all channels sharing the same stages and background jobs.
+// Each input spectrum is calculated once and reused for every kernel it feeds,
+// and pairs of channels go through a single complex FFT.
+//
+// Instead of a fixed IR it can also morph between 2 of them. Their spectra are mixed into kernels of our own,
+// and mixed again when the morph amount changes, a few partitions per block of every stage.
+// This runs wherever the stage runs, so kernels are never changed while being used.
+
+class MultiStageThreadedConvolver
+{
+public:
+    static constexpr const size_t kMaxChannels = 2;
+
+    // largest head block (and so FIR length) done in the time domain for unaligned buffer sizes
+    static constexpr const size_t kMaxDirectHeadSize = 256;
+
+    // partitions mixed per block of every stage while morphing, for every pair of kernels
+    static constexpr const size_t kMorphPartitionsPerBlock = 4;
+
+private:
+   #ifndef DISTRHO_OS_WASM
+    // background stages with at least this many partitions per worker get their partitions split between workers
+    static constexpr const size_t kMinPartitionsPerRange = 8;
+    static constexpr const size_t kMaxRangeJobs = 7;
+
+    struct PartitionRangeJob;
+   #endif
+
+    // uniformly partitioned convolution of one kernel stage, same algorithm as fftconvolver::FFTConvolver
+    // extended to a matrix of kernels, where each output is the sum of every input convolved with its own kernel.
+    // every input is only transformed once and every output only transformed back once,
+    // the (cheap) complex multiply-accumulate is the only thing done per kernel.
+    // null kernels are skipped, so a stereo IR is a matrix with only its diagonal set.
+    struct StageConvolver {
+        const size_t numInputs;
+        const size_t numOutputs;
+        const size_t blockSize;
+        const size_t irOffset;
+        const size_t numPartitions;
+        const size_t complexSize;
+
+        // the delay lines keep `maxShift` extra blocks, partitions are matched with input blocks `shift` blocks older.
+        // this delays the input by whole blocks without any extra work, used for pre-delay.
+        // changes are picked up at the start of the next block.
+        const size_t maxShift;
+        const size_t numSegments;
+        size_t shift;
+        size_t pendingShift;
+
+        // partitions past `limit` are not processed, with the last one scaled by `limitGain`.
+        // a limit of 0 makes the whole stage silent, its state is reset once it comes back.
+        size_t limit;
+        float limitGain;
+        bool resetPending;
+
+        // indexed as [output][input]
+        const ConvolutionKernel::Stage* kernels[kMaxChannels][kMaxChannels];
+
+        // multiply-accumulate for the instruction set of this CPU
+        const ConvolutionSIMD& simd;
+
+        // partition 0 done by a direct-form FIR instead, with `directTaps` holding it reversed in the time domain
+        // (empty for silent kernels) and `directInputs` the previous and current input block back to back.
+        // all other partitions only depend on complete blocks, see `processDirect`.
+        const bool direct;
+        fftconvolver::SampleBuffer directTaps[kMaxChannels][kMaxChannels];
+        fftconvolver::SampleBuffer directInputs[kMaxChannels];
+        audiofft::AudioFFT directFFT;
+        fftconvolver::SplitComplex directSpectrum;
+        fftconvolver::SampleBuffer directBuffer;
+
+        // kernels mixed from 2 others while morphing, each listed once even if used by several paths.
+        // a sweep mixes all of their partitions with the same amount, `pendingMorph` is picked up by the next one.
+        struct MorphPath {
+            ConvolutionKernel::Stage* mix;
+            const ConvolutionKernel::Stage* from;
+            const ConvolutionKernel::Stage* to;
+        };
+        MorphPath morphPaths[kMaxChannels * kMaxChannels];
+        size_t numMorphPaths;
+        size_t morphPosition;
+        float morph;
+        float pendingMorph;
+
+        // mono transforms, and stereo ones done as a single complex FFT
+        audiofft::AudioFFT fft;
+        JointStereoFFT jointFFT;
+
+        fftconvolver::SampleBuffer fftBuffers[kMaxChannels];
+        fftconvolver::SampleBuffer inputBuffers[kMaxChannels];
+        fftconvolver::SampleBuffer overlaps[kMaxChannels];
+        fftconvolver::SplitComplex preMultiplied[kMaxChannels];
+        fftconvolver::SplitComplex convs[kMaxChannels];
+
+        // frequency-domain delay lines, spectra of the last `numSegments` input blocks stored back to back
+        fftconvolver::SampleBuffer segmentsRe[kMaxChannels];
+        fftconvolver::SampleBuffer segmentsIm[kMaxChannels];
+        size_t current;
+        size_t inputBufferFill;
+
+        // whether the current block only had silence so far, and for how many complete blocks before it (up to all).
+        // silent blocks are not transformed and the partitions they meet are skipped,
+        // once they fill the whole delay line the stage is idle and outputs silence without doing anything.
+        bool blockSilent;
+        size_t silentBlocks;
+
+       #ifndef DISTRHO_OS_WASM
+        // older partitions from `rangeJobs[0]->first` onwards are split into ranges done concurrently by other workers,
+        // set up by the owner for stages with enough partitions to be worth it.
+        ConvolutionWorkerPool* pool;
+        PartitionRangeJob* rangeJobs[kMaxRangeJobs];
+        size_t numRangeJobs;
+       #endif
+
+        StageConvolver(const ConvolutionKernel::Stage* const stages[kMaxChannels][kMaxChannels],
+                       const size_t numInputs_, const size_t numOutputs_, const size_t maxPreDelay,
+                       const bool direct_ = false)
+            : numInputs(numInputs_),
+              numOutputs(numOutputs_),
+              blockSize(stages[0][0]->blockSize),
+              irOffset(stages[0][0]->irOffset),
+              numPartitions(stages[0][0]->numPartitions),
+              complexSize(stages[0][0]->complexSize),
+              maxShift(numPartitions != 0 ? maxPreDelay / blockSize : 0),
+              numSegments(numPartitions + maxShift),
+              shift(0),
+              pendingShift(0),
+              limit(numPartitions),
+              limitGain(1.f),
+              resetPending(false),
+              simd(ConvolutionSIMD::getInstance()),
+              direct(direct_),
+              numMorphPaths(0),
+              morphPosition(numPartitions),
+              morph(0.f),
+              pendingMorph(0.f),
+              current(0),
+              inputBufferFill(0),
+              blockSilent(true),
+              silentBlocks(numSegments)
+             #ifndef DISTRHO_OS_WASM
+            , pool(nullptr),
+              numRangeJobs(0)
+             #endif
+        {
+            if (numInputs == 1 || numOutputs == 1)
+                fft.init(blockSize * 2);
+            if (numInputs == 2 || numOutputs == 2)
+                jointFFT.init(blockSize * 2);
+
+            for (size_t c = 0; c < kMaxChannels; ++c)
+            {
+                for (size_t i = 0; i < kMaxChannels; ++i)
+                    kernels[c][i] = c < numOutputs && i < numInputs ? stages[c][i] : nullptr;
+
+                if (c < numInputs)
+                {
+                    inputBuffers[c].resize(blockSize);
+                    segmentsRe[c].resize(numSegments * complexSize);
+                    segmentsIm[c].resize(numSegments * complexSize);
+                }
+
+                if (c < numOutputs)
+                {
+                    fftBuffers[c].resize(blockSize * 2);
+                    overlaps[c].resize(blockSize);
+                    preMultiplied[c].resize(complexSize);
+                    convs[c].resize(complexSize);
+                }
+            }
+
+            if (direct)
+                initDirect();
+        }
+
+        // set up the FIR, with taps for every kernel where partition 0 is not silent
+        void initDirect()
+        {
+            directFFT.init(blockSize * 2);
+            directSpectrum.resize(complexSize);
+            directBuffer.resize(blockSize * 2);
+
+            for (size_t i = 0; i < numInputs; ++i)
+                directInputs[i].resize(blockSize * 2);
+
+            for (size_t o = 0; o < numOutputs; ++o)
+            {
+                for (size_t i = 0; i < numInputs; ++i)
+                {
+                    if (kernels[o][i] != nullptr && kernels[o][i]->isActive(0))
+                        directTaps[o][i].resize(blockSize);
+                }
+            }
+
+            updateDirectTaps();
+        }
+
+        // get the time-domain taps of partition 0 back out of the kernels
+        void updateDirectTaps()
+        {
+            for (size_t o = 0; o < numOutputs; ++o)
+            {
+                for (size_t i = 0; i < numInputs; ++i)
+                {
+                    if (directTaps[o][i].size() == 0)
+                        continue;
+
+                    const ConvolutionKernel::Stage& kernel(*kernels[o][i]);
+
+                    if (kernel.compact)
+                    {
+                        for (size_t k = 0; k < complexSize; ++k)
+                        {
+                            directSpectrum.re()[k] = ConvolutionKernel::fromCompact(kernel.compactPartitionRe(0)[k]);
+                            directSpectrum.im()[k] = ConvolutionKernel::fromCompact(kernel.compactPartitionIm(0)[k]);
+                        }
+                    }
+                    else
+                    {
+                        std::memcpy(directSpectrum.re(), kernel.partitionRe(0),
+                                    sizeof(fftconvolver::Sample) * complexSize);
+                        std::memcpy(directSpectrum.im(), kernel.partitionIm(0),
+                                    sizeof(fftconvolver::Sample) * complexSize);
+                    }
+
+                    directFFT.ifft(directBuffer.data(), directSpectrum.re(), directSpectrum.im());
+                    std::reverse_copy(directBuffer.data(), directBuffer.data() + blockSize, directTaps[o][i].data());
+                }
+            }
+        }
+
+        // mix `mix` from `from` and `to` while morphing, sharing the work with other paths using the same mix
+        void addMorphPath(ConvolutionKernel::Stage* const mix,
+                          const ConvolutionKernel::Stage* const from,
+                          const ConvolutionKernel::Stage* const to,
+                          const float amount) noexcept
+        {
+            for (size_t m = 0; m < numMorphPaths; ++m)
+            {
+                if (morphPaths[m].mix == mix)
+                    return;
+            }
+
+            morphPaths[numMorphPaths].mix = mix;
+            morphPaths[numMorphPaths].from = from;
+            morphPaths[numMorphPaths].to = to;
+            ++numMorphPaths;
+
+            morph = pendingMorph = amount;
+        }
+
+        // mix the next few partitions of the current morph sweep, to be called at the start of a block.
+        // once a sweep is complete, a new one starts if the amount changed in the meantime.
+        void updateMorph()
+        {
+            if (numMorphPaths == 0)
+                return;
+
+            if (morphPosition == numPartitions)
+            {
+                if (d_isEqual(morph, pendingMorph))
+                    return;
+
+                morph = pendingMorph;
+                morphPosition = 0;
+            }
+
+            for (size_t mixed = 0; mixed < kMorphPartitionsPerBlock && morphPosition < numPartitions; ++morphPosition)
+            {
+                bool active = false;
+
+                for (size_t m = 0; m < numMorphPaths; ++m)
+                {
+                    const MorphPath& path(morphPaths[m]);
+
+                    if (path.mix->isActive(morphPosition))
+                    {
+                        path.mix->blend(morphPosition, path.from, path.to, morph);
+                        active = true;
+                    }
+                }
+
+                if (! active)
+                    continue;
+
+                if (direct && morphPosition == 0)
+                    updateDirectTaps();
+
+                ++mixed;
+            }
+        }
+
+        // find the limit for an IR cut at `length` samples, the last partition is faded by how much of it remains
+        void getLimit(const size_t length, size_t& newLimit, float& newLimitGain) const noexcept
+        {
+            if (length <= irOffset)
+            {
+                newLimit = 0;
+                newLimitGain = 1.f;
+                return;
+            }
+
+            const size_t remaining = length - irOffset;
+
+            if (remaining >= numPartitions * blockSize)
+            {
+                newLimit = numPartitions;
+                newLimitGain = 1.f;
+                return;
+            }
+
+            newLimit = (remaining + blockSize - 1) / blockSize;
+            newLimitGain = static_cast<float>(remaining - (newLimit - 1) * blockSize) / blockSize;
+        }
+
+        // split a pre-delay into whole blocks done by shifting, and the remaining samples to be done before
+        void getShift(const size_t preDelay, size_t& newShift, size_t& remaining) const noexcept
+        {
+            newShift = std::min(maxShift, preDelay / blockSize);
+            remaining = preDelay - newShift * blockSize;
+        }
+
+        void setLimit(const size_t newLimit, const float newLimitGain) noexcept
+        {
+            if (limit == 0 && newLimit != 0)
+                resetPending = true;
+
+            limit = newLimit;
+            limitGain = newLimitGain;
+        }
+
+        void reset()
+        {
+            for (size_t i = 0; i < numInputs; ++i)
+            {
+                inputBuffers[i].setZero();
+                directInputs[i].setZero();
+                segmentsRe[i].setZero();
+                segmentsIm[i].setZero();
+            }
+
+            for (size_t o = 0; o < numOutputs; ++o)
+                overlaps[o].setZero();
+
+            current = 0;
+            inputBufferFill = 0;
+            blockSilent = true;
+            silentBlocks = numSegments;
+            resetPending = false;
+        }
+
+        // nothing left in the delay line or overlaps, only new input can make this stage output anything
+        bool isIdle() const noexcept
+        {
+            return silentBlocks == numSegments;
+        }
+
+        static bool isSilent(const fftconvolver::Sample* const data, const size_t len) noexcept
+        {
+            for (size_t i = 0; i < len; ++i)
+            {
+                if (data[i] != 0.f)
+                    return false;
+            }
+
+            return true;
+        }
+
+        // to be called before processing `len` samples from `inputs` at `offset`, returns true if idle for them
+        bool updateSilence(const fftconvolver::Sample* const* const inputs, const size_t offset, const size_t len)
+        {
+            if (inputBufferFill == 0)
+                blockSilent = true;
+
+            for (size_t i = 0; i < numInputs && blockSilent; ++i)
+                blockSilent = isSilent(inputs[i] + offset, len);
+
+            return blockSilent && isIdle();
+        }
+
+        // move on to the next block, once the current one is complete
+        void nextBlock() noexcept
+        {
+            silentBlocks = blockSilent ? std::min(silentBlocks + 1, numSegments) : 0;
+            inputBufferFill = 0;
+            current = current > 0 ? current - 1 : numSegments - 1;
+        }
+
+        // silence the current segment instead of transforming a silent block into it
+        void clearCurrentSegment()
+        {
+            for (size_t i = 0; i < numInputs; ++i)
+            {
+                std::memset(segmentRe(i, current), 0, sizeof(fftconvolver::Sample) * complexSize);
+                std::memset(segmentIm(i, current), 0, sizeof(fftconvolver::Sample) * complexSize);
+            }
+        }
+
+        void process(const fftconvolver::Sample* const* const inputs,
+                     fftconvolver::Sample* const* const outputs,
+                     const size_t len)
+        {
+            if (numPartitions == 0 || limit == 0)
+            {
+                for (size_t o = 0; o < numOutputs; ++o)
+                    std::memset(outputs[o], 0, sizeof(fftconvolver::Sample) * len);
+                return;
+            }
+
+            // whatever was kept from before being silenced is stale
+            if (resetPending)
+                reset();
+
+            if (direct)
+            {
+                processDirect(inputs, outputs, len);
+                return;
+            }
+
+            const fftconvolver::Sample* blocks[kMaxChannels];
+
+            for (size_t i = 0; i < numInputs; ++i)
+                blocks[i] = inputBuffers[i].data();
+
+            for (size_t processed = 0, processing; processed < len; processed += processing)
+            {
+                const bool inputBufferWasEmpty = inputBufferFill == 0;
+                const size_t inputBufferPos = inputBufferFill;
+                processing = std::min(len - processed, blockSize - inputBufferFill);
+
+                if (inputBufferWasEmpty)
+                {
+                    shift = pendingShift;
+                    updateMorph();
+                }
+
+                if (updateSilence(inputs, processed, processing))
+                {
+                    for (size_t o = 0; o < numOutputs; ++o)
+                        std::memset(outputs[o] + processed, 0, sizeof(fftconvolver::Sample) * processing);
+
+                    inputBufferFill += processing;
+                    if (inputBufferFill == blockSize)
+                        nextBlock();
+                    continue;
+                }
+
+                // forward FFT, once per input
+                for (size_t i = 0; i < numInputs; ++i)
+                    std::memcpy(inputBuffers[i].data() + inputBufferPos, inputs[i] + processed,
+                                sizeof(fftconvolver::Sample) * processing);
+
+                if (! blockSilent)
+                    transformInputs(blocks);
+                else if (inputBufferWasEmpty)
+                    clearCurrentSegment();
+
+                // complex multiplication, older partitions only need to be done once per block
+                if (inputBufferWasEmpty)
+                    multiplyAccumulateOlder();
+
+                for (size_t o = 0; o < numOutputs; ++o)
+                {
+                    convs[o].copyFrom(preMultiplied[o]);
+
+                    for (size_t i = 0; i < numInputs; ++i)
+                    {
+                        if (kernels[o][i] == nullptr)
+                            continue;
+
+                        const ConvolutionKernel::Stage& kernel(*kernels[o][i]);
+                        if (kernel.numActive == 0 || kernel.activeData[0] != 0 || isSilentPartition(0))
+                            continue;
+
+                        multiplyAccumulate(convs[o], kernel, 0, i, (current + shift) % numSegments);
+                    }
+                }
+
+                // backward FFT, once per output
+                if (numOutputs == 2)
+                    jointFFT.ifft(fftBuffers[0].data(), fftBuffers[1].data(),
+                                  convs[0].re(), convs[0].im(), convs[1].re(), convs[1].im());
+                else
+                    fft.ifft(fftBuffers[0].data(), convs[0].re(), convs[0].im());
+
+                for (size_t o = 0; o < numOutputs; ++o)
+                {
+                    // add overlap
+                    fftconvolver::Sum(outputs[o] + processed, fftBuffers[o].data() + inputBufferPos,
+                                      overlaps[o].data() + inputBufferPos, processing);
+
+                    // keep overlap for the next block
+                    if (inputBufferFill + processing == blockSize)
+                        std::memcpy(overlaps[o].data(), fftBuffers[o].data() + blockSize,
+                                    sizeof(fftconvolver::Sample) * blockSize);
+                }
+
+                // input buffer full, move on to the next block
+                inputBufferFill += processing;
+                if (inputBufferFill == blockSize)
+                {
+                    for (size_t i = 0; i < numInputs; ++i)
+                        inputBuffers[i].setZero();
+
+                    nextBlock();
+                }
+            }
+        }
+
+        // with partition 0 left to the FIR, the output of a whole block is known as soon as it starts.
+        // a single forward and backward FFT per block, no matter how small the chunks it comes in.
+        void processDirect(const fftconvolver::Sample* const* const inputs,
+                           fftconvolver::Sample* const* const outputs,
+                           const size_t len)
+        {
+            const float gain = limit != 1 ? 1.f : limitGain;
+
+            for (size_t processed = 0, processing; processed < len; processed += processing)
+            {
+                const size_t inputBufferPos = inputBufferFill;
+                processing = std::min(len - processed, blockSize - inputBufferFill);
+
+                if (inputBufferPos == 0)
+                {
+                    shift = pendingShift;
+                    updateMorph();
+                }
+
+                if (updateSilence(inputs, processed, processing))
+                {
+                    for (size_t o = 0; o < numOutputs; ++o)
+                        std::memset(outputs[o] + processed, 0, sizeof(fftconvolver::Sample) * processing);
+
+                    inputBufferFill += processing;
+                    if (inputBufferFill == blockSize)
+                        nextBlock();
+                    continue;
+                }
+
+                // the FIR reads back up to a block before the first sample, so needs the previous block silent too
+                const bool firSilent = blockSilent && silentBlocks != 0;
+
+                if (inputBufferPos == 0)
+                {
+                    multiplyAccumulateOlder();
+
+                    if (numOutputs == 2)
+                        jointFFT.ifft(fftBuffers[0].data(), fftBuffers[1].data(),
+                                      preMultiplied[0].re(), preMultiplied[0].im(),
+                                      preMultiplied[1].re(), preMultiplied[1].im());
+                    else
+                        fft.ifft(fftBuffers[0].data(), preMultiplied[0].re(), preMultiplied[0].im());
+                }
+
+                for (size_t i = 0; i < numInputs; ++i)
+                    std::memcpy(directInputs[i].data() + blockSize + inputBufferPos, inputs[i] + processed,
+                                sizeof(fftconvolver::Sample) * processing);
+
+                for (size_t o = 0; o < numOutputs; ++o)
+                {
+                    fftconvolver::Sum(outputs[o] + processed, fftBuffers[o].data() + inputBufferPos,
+                                      overlaps[o].data() + inputBufferPos, processing);
+
+                    for (size_t i = 0; i < numInputs && ! firSilent; ++i)
+                    {
+                        if (directTaps[o][i].size() != 0)
+                            simd.fir(outputs[o] + processed, directInputs[i].data() + inputBufferPos + 1,
+                                     directTaps[o][i].data(), blockSize, processing, gain);
+                    }
+                }
+
+                // input block complete, transform it for the next ones and keep it for the FIR
+                inputBufferFill += processing;
+                if (inputBufferFill == blockSize)
+                {
+                    const fftconvolver::Sample* blocks[kMaxChannels];
+
+                    for (size_t o = 0; o < numOutputs; ++o)
+                        std::memcpy(overlaps[o].data(), fftBuffers[o].data() + blockSize,
+                                    sizeof(fftconvolver::Sample) * blockSize);
+
+                    for (size_t i = 0; i < numInputs; ++i)
+                        blocks[i] = directInputs[i].data() + blockSize;
+
+                    if (! blockSilent)
+                        transformInputs(blocks);
+                    else
+                        clearCurrentSegment();
+
+                    for (size_t i = 0; i < numInputs; ++i)
+                        std::memcpy(directInputs[i].data(), directInputs[i].data() + blockSize,
+                                    sizeof(fftconvolver::Sample) * blockSize);
+
+                    nextBlock();
+                }
+            }
+        }
+
+        // forward FFT of a zero-padded block of every input into the current segment, once per input
+        void transformInputs(const fftconvolver::Sample* const* const blocks)
+        {
+            if (numInputs == 2)
+            {
+                jointFFT.fft(blocks[0], blocks[1], blockSize,
+                             segmentRe(0, current), segmentIm(0, current),
+                             segmentRe(1, current), segmentIm(1, current));
+            }
+            else
+            {
+                std::memcpy(fftBuffers[0].data(), blocks[0], sizeof(fftconvolver::Sample) * blockSize);
+                std::memset(fftBuffers[0].data() + blockSize, 0, sizeof(fftconvolver::Sample) * blockSize);
+                fft.fft(fftBuffers[0].data(), segmentRe(0, current), segmentIm(0, current));
+            }
+        }
+
+        // sum of every partition except the first one into `preMultiplied`
+        void multiplyAccumulateOlder()
+        {
+           #ifndef DISTRHO_OS_WASM
+            // the owner is waiting on these, so they go before anything else
+            for (size_t j = 0; j < numRangeJobs; ++j)
+            {
+                if (rangeJobs[j]->first < limit)
+                    pool->submitJob(rangeJobs[j], 0);
+            }
+
+            const size_t last = numRangeJobs != 0 ? rangeJobs[0]->first : numPartitions;
+           #else
+            const size_t last = numPartitions;
+           #endif
+
+            for (size_t o = 0; o < numOutputs; ++o)
+            {
+                preMultiplied[o].setZero();
+                multiplyAccumulateRange(preMultiplied[o], o, 1, last);
+            }
+
+           #ifndef DISTRHO_OS_WASM
+            for (size_t j = 0; j < numRangeJobs; ++j)
+            {
+                if (rangeJobs[j]->first >= limit)
+                    continue;
+
+                pool->waitForJob(rangeJobs[j]);
+
+                for (size_t o = 0; o < numOutputs; ++o)
+                {
+                    fftconvolver::Sum(preMultiplied[o].re(), preMultiplied[o].re(), rangeJobs[j]->results[o].re(), complexSize);
+                    fftconvolver::Sum(preMultiplied[o].im(), preMultiplied[o].im(), rangeJobs[j]->results[o].im(), complexSize);
+                }
+            }
+           #endif
+        }
+
+        // accumulate partitions [first, last) of every kernel feeding `output`, safe to call from several threads at once
+        void multiplyAccumulateRange(fftconvolver::SplitComplex& result, const size_t output,
+                                     const size_t first, const size_t last)
+        {
+            const size_t end = std::min(last, limit);
+
+            // partitions only meeting silent blocks have nothing to add
+            const size_t begin = std::max(first, silentBlocks >= shift ? silentBlocks - shift + 1 : 0);
+
+            for (size_t i = 0; i < numInputs; ++i)
+            {
+                if (kernels[output][i] == nullptr)
+                    continue;
+
+                const ConvolutionKernel::Stage& kernel(*kernels[output][i]);
+                const uint32_t* const activeEnd = kernel.activeData + kernel.numActive;
+
+                // silent partitions contribute nothing, only go through the active ones
+                for (const uint32_t* a = std::lower_bound(kernel.activeData, activeEnd, begin);
+                     a != activeEnd && *a < end; ++a)
+                {
+                    multiplyAccumulate(result, kernel, *a, i, (current + shift + *a) % numSegments);
+                }
+            }
+        }
+
+        // accumulate kernel partition `p` times input segment `index`, fading it if it is the last one
+        void multiplyAccumulate(fftconvolver::SplitComplex& result, const ConvolutionKernel::Stage& kernel,
+                                const size_t p, const size_t input, const size_t index)
+        {
+            const fftconvolver::Sample* const bRe = segmentRe(input, index);
+            const fftconvolver::Sample* const bIm = segmentIm(input, index);
+
+            if (kernel.compact)
+            {
+                simd.compactMultiplyAccumulate(result.re(), result.im(),
+                                               kernel.compactPartitionRe(p), kernel.compactPartitionIm(p),
+                                               bRe, bIm, complexSize, p + 1 != limit ? 1.f : limitGain);
+                return;
+            }
+
+            const fftconvolver::Sample* const aRe = kernel.partitionRe(p);
+            const fftconvolver::Sample* const aIm = kernel.partitionIm(p);
+
+            if (p + 1 != limit || limitGain >= 1.f)
+            {
+                simd.multiplyAccumulate(result.re(), result.im(), aRe, aIm, bRe, bIm, complexSize);
+                return;
+            }
+
+            fftconvolver::Sample* const re = result.re();
+            fftconvolver::Sample* const im = result.im();
+
+            for (size_t k = 0; k < complexSize; ++k)
+            {
+                re[k] += (aRe[k] * bRe[k] - aIm[k] * bIm[k]) * limitGain;
+                im[k] += (aRe[k] * bIm[k] + aIm[k] * bRe[k]) * limitGain;
+            }
+        }
+
+        // whether partition `p` only meets silent input in this block
+        bool isSilentPartition(const size_t p) const noexcept
+        {
+            const size_t age = p + shift;
+            return age == 0 ? blockSilent : age <= silentBlocks;
+        }
+
+        fftconvolver::Sample* segmentRe(const size_t input, const size_t index) noexcept
+        {
+            return segmentsRe[input].data() + index * complexSize;
+        }
+
+        fftconvolver::Sample* segmentIm(const size_t input, const size_t index) noexcept
+        {
+            return segmentsIm[input].data() + index * complexSize;
+        }
+
+        DISTRHO_DECLARE_NON_COPYABLE(StageConvolver)
+    };
+
+   #ifndef DISTRHO_OS_WASM
+    // a range of older partitions of a stage, multiplied and accumulated on another worker while the stage does the rest
+    struct PartitionRangeJob : ConvolutionWorkerPool::Job {
+        StageConvolver& convolver;
+        const size_t first;
+        const size_t last;
+        fftconvolver::SplitComplex results[kMaxChannels];
+
+        PartitionRangeJob(StageConvolver& convolver_, const size_t first_, const size_t last_)
+            : ConvolutionWorkerPool::Job(),
+              convolver(convolver_),
+              first(first_),
+              last(last_)
+        {
+            for (size_t o = 0; o < convolver.numOutputs; ++o)
+                results[o].resize(convolver.complexSize);
+        }
+
+        void runJob() override
+        {
+            for (size_t o = 0; o < convolver.numOutputs; ++o)
+            {
+                results[o].setZero();
+                convolver.multiplyAccumulateRange(results[o], o, first, last);
+            }
+        }
+
+        DISTRHO_DECLARE_NON_COPYABLE(PartitionRangeJob)
+    };
+   #endif
+
+   #ifndef DISTRHO_OS_WASM
+    struct BackgroundStage : ConvolutionWorkerPool::Job
+   #else
+    struct BackgroundStage
+   #endif
+    {
+        StageConvolver convolver;
+       #ifndef DISTRHO_OS_WASM
+        ConvolutionWorkerPool::SharedInstance& pool;
+        const uint64_t deadlineNs;
+
+        // when not null, jobs run in the audio thread instead, adding their CPU time to it
+        uint64_t* const inlineTimeNs;
+
+        // optional, with the time of the last submit for finding out if the job was late
+        ConvolutionStats* stats;
+        uint64_t submitTimeNs;
+       #endif
+        const size_t blockSize;
+        size_t inputFill;
+        bool processing;
+
+        // limit, shift and morph amount for the next job, set by the audio thread
+        size_t pendingLimit;
+        float pendingLimitGain;
+        size_t pendingShift;
+        float pendingMorph;
+
+        // pre-delay samples not covered by the shift, taken from the input history as the block is collected.
+        // both are latched at the start of a block, so a block is always collected and convolved with the same ones.
+        size_t historyDelay;
+        size_t pendingHistoryDelay;
+        size_t blockShift;
+
+        // input being collected by the audio thread, and a copy of it handed over to the background.
+        // a silent block does not need a job while the convolver is idle.
+        fftconvolver::SampleBuffer inputs[kMaxChannels];
+        fftconvolver::SampleBuffer backgroundInputs[kMaxChannels];
+        bool inputSilent;
+
+        // output of the last finished job being mixed in, and the output of the job currently running.
+        // outputs of skipped jobs are not written, only flagged as silent.
+        fftconvolver::SampleBuffer outputs[2][kMaxChannels];
+        bool outputsSilent[2];
+        uint precalculatedIndex;
+
+       #ifndef DISTRHO_OS_WASM
+        ScopedPointer<PartitionRangeJob> rangeJobs[kMaxRangeJobs];
+       #endif
+
+       #ifndef DISTRHO_OS_WASM
+        BackgroundStage(ConvolutionWorkerPool::SharedInstance& pool_,
+                        const ConvolutionKernel::Stage* const stages[kMaxChannels][kMaxChannels],
+                        const size_t numInputs, const size_t numOutputs,
+                        const size_t maxPreDelay, const double sampleRate, uint64_t* const inlineTimeNs_)
+            : ConvolutionWorkerPool::Job(),
+              convolver(stages, numInputs, numOutputs, maxPreDelay),
+              pool(pool_),
+              deadlineNs(static_cast<uint64_t>(convolver.blockSize * 1000000000.0 / sampleRate)),
+              inlineTimeNs(inlineTimeNs_),
+              stats(nullptr),
+              submitTimeNs(0),
+       #else
+        BackgroundStage(const ConvolutionKernel::Stage* const stages[kMaxChannels][kMaxChannels],
+                        const size_t numInputs, const size_t numOutputs, const size_t maxPreDelay)
+            : convolver(stages, numInputs, numOutputs, maxPreDelay),
+       #endif
+              blockSize(convolver.blockSize),
+              inputFill(0),
+              processing(false),
+              pendingLimit(convolver.numPartitions),
+              pendingLimitGain(1.f),
+              pendingShift(0),
+              pendingMorph(0.f),
+              historyDelay(0),
+              pendingHistoryDelay(0),
+              blockShift(0),
+              inputSilent(true),
+              precalculatedIndex(0)
+        {
+            outputsSilent[0] = outputsSilent[1] = true;
+
+            for (size_t i = 0; i < numInputs; ++i)
+            {
+                inputs[i].resize(blockSize);
+                backgroundInputs[i].resize(blockSize);
+            }
+
+            for (size_t o = 0; o < numOutputs; ++o)
+            {
+                outputs[0][o].resize(blockSize);
+                outputs[1][o].resize(blockSize);
+            }
+
+           #ifndef DISTRHO_OS_WASM
+            // long stages split their older partitions evenly between this job and up to 1 extra job per other worker
+            const size_t numOlder = convolver.numPartitions > 1 ? convolver.numPartitions - 1 : 0;
+            const size_t numRanges = std::min<size_t>(std::min<size_t>(pool->getNumWorkers(), kMaxRangeJobs + 1),
+                                                      numOlder / kMinPartitionsPerRange);
+
+            if (numRanges > 1 && inlineTimeNs == nullptr)
+            {
+                for (size_t r = 1; r < numRanges; ++r)
+                    rangeJobs[r - 1] = new PartitionRangeJob(convolver,
+                                                             1 + numOlder * r / numRanges,
+                                                             1 + numOlder * (r + 1) / numRanges);
+
+                convolver.pool = pool.pool;
+                convolver.numRangeJobs = numRanges - 1;
+
+                for (size_t j = 0; j < convolver.numRangeJobs; ++j)
+                    convolver.rangeJobs[j] = rangeJobs[j].get();
+            }
+           #endif
+        }
+
+       #ifndef DISTRHO_OS_WASM
+        ~BackgroundStage() override
+        {
+            pool->cancelJob(this);
+
+            // range jobs are done by the time this one is, but might still have stale entries in the queues
+            for (size_t j = 0; j < kMaxRangeJobs; ++j)
+            {
+                if (rangeJobs[j] != nullptr)
+                    pool->cancelJob(rangeJobs[j].get());
+            }
+        }
+       #endif
+
+        // null if silent
+        const fftconvolver::Sample* getPrecalculated(const size_t output) const noexcept
+        {
+            return outputsSilent[precalculatedIndex] ? nullptr : outputs[precalculatedIndex][output].data();
+        }
+
+        // called once per completed input block, mixes in the previous result and schedules the next one
+        void blockCompleted()
+        {
+            if (processing)
+            {
+               #ifndef DISTRHO_OS_WASM
+                if (stats != nullptr && ! pool->isJobFinished(this))
+                {
+                    const uint64_t waitStartNs = ConvolutionWorkerPool::getTimeNs();
+                    pool->waitForJob(this);
+                    stats->addWait(ConvolutionWorkerPool::getTimeNs() - waitStartNs);
+                }
+                else
+                {
+                    pool->waitForJob(this);
+                }
+               #endif
+                processing = false;
+            }
+
+            precalculatedIndex = 1 - precalculatedIndex;
+
+            // no job is running, safe to change what the next one does
+            convolver.setLimit(pendingLimit, pendingLimitGain);
+            convolver.pendingShift = blockShift;
+            convolver.pendingMorph = pendingMorph;
+
+            // cut off entirely, or silence with nothing left to ring out, skip the job
+            outputsSilent[1 - precalculatedIndex] = convolver.limit == 0 || (inputSilent && convolver.isIdle());
+
+            if (outputsSilent[1 - precalculatedIndex])
+                return;
+
+            for (size_t i = 0; i < convolver.numInputs; ++i)
+                backgroundInputs[i].copyFrom(inputs[i]);
+
+            processing = true;
+
+           #ifndef DISTRHO_OS_WASM
+            if (inlineTimeNs != nullptr)
+            {
+                const uint64_t startNs = ConvolutionWorkerPool::getTimeNs();
+                doBackgroundProcessing();
+                *inlineTimeNs += ConvolutionWorkerPool::getTimeNs() - startNs;
+                return;
+            }
+
+            if (stats != nullptr)
+                submitTimeNs = ConvolutionWorkerPool::getTimeNs();
+
+            pool->submitJob(this, deadlineNs);
+           #else
+            doBackgroundProcessing();
+           #endif
+        }
+
+        void doBackgroundProcessing()
+        {
+            const fftconvolver::Sample* ins[kMaxChannels];
+            fftconvolver::Sample* outs[kMaxChannels];
+
+            for (size_t i = 0; i < convolver.numInputs; ++i)
+                ins[i] = backgroundInputs[i].data();
+
+            for (size_t o = 0; o < convolver.numOutputs; ++o)
+                outs[o] = outputs[1 - precalculatedIndex][o].data();
+
+            convolver.process(ins, outs, blockSize);
+        }
+
+       #ifndef DISTRHO_OS_WASM
+        void runJob() override
+        {
+            if (stats == nullptr)
+            {
+                doBackgroundProcessing();
+                return;
+            }
+
+            const uint64_t startNs = ConvolutionWorkerPool::getTimeNs();
+            doBackgroundProcessing();
+            const uint64_t endNs = ConvolutionWorkerPool::getTimeNs();
+
+            stats->addJob(endNs - startNs, endNs > submitTimeNs + deadlineNs);
+        }
+       #endif
+
+        DISTRHO_DECLARE_NON_COPYABLE(BackgroundStage)
+    };
+
+   #ifndef DISTRHO_OS_WASM
+    ConvolutionWorkerPool::SharedInstance pool;
+    uint64_t* inlineTimeNs;
+   #endif
+    std::shared_ptr<const ConvolutionKernel> kernels[kMaxChannels][kMaxChannels];
+    size_t numInputs;
+    size_t numOutputs;
+    ScopedPointer<StageConvolver> headConvolver;
+    ScopedPointer<BackgroundStage> stages[ConvolutionKernel::kMaxStages - 1];
+    size_t numBackgroundStages;
+    size_t irLength;
+
+    // pre-delay, done by the stages shifting their delay lines plus reading their input this much in the past
+    size_t maxPreDelay;
+    size_t headHistoryDelay;
+    size_t pendingHeadHistoryDelay;
+    size_t pendingHeadShift;
+    size_t historySize;
+    size_t historyPosition;
+    fftconvolver::SampleBuffer histories[kMaxChannels];
+    fftconvolver::SampleBuffer headInputs[kMaxChannels];
+
+    // leading silence trimmed from the kernels, applied as a plain delay on the inputs
+    size_t delay;
+    size_t delayPosition;
+    fftconvolver::SampleBuffer delayLines[kMaxChannels];
+    fftconvolver::SampleBuffer delayedInputs[kMaxChannels];
+
+    // kernels being morphed between, and our own mixes of them used as `kernels`
+    std::shared_ptr<const ConvolutionKernel> morphFrom[kMaxChannels][kMaxChannels];
+    std::shared_ptr<const ConvolutionKernel> morphTo[kMaxChannels][kMaxChannels];
+    std::shared_ptr<ConvolutionKernel> morphMixes[kMaxChannels][kMaxChannels];
+
+public:
+    MultiStageThreadedConvolver()
+        :
+         #ifndef DISTRHO_OS_WASM
+          inlineTimeNs(nullptr),
+         #endif
+          numInputs(0),
+          numOutputs(0),
+          numBackgroundStages(0),
+          irLength(0),
+          maxPreDelay(0),
+          headHistoryDelay(0),
+          pendingHeadHistoryDelay(0),
+          pendingHeadShift(0),
+          historySize(0),
+          historyPosition(0),
+          delay(0),
+          delayPosition(0) {}
+
+    // convolve `numInputs` channels into `numOutputs` channels, with `newKernels` indexed as [output][input].
+    // all kernels must share the same layout and length, null kernels are allowed except for the 1st one.
+    // `newMaxPreDelay` is the longest pre-delay that can be set later, in samples.
+    // `bufferSize` is how many samples `process` is usually called with, 0 if unknown.
+    bool init(const std::shared_ptr<const ConvolutionKernel> newKernels[kMaxChannels][kMaxChannels],
+              const size_t newNumInputs, const size_t newNumOutputs, const double sampleRate,
+              const size_t newMaxPreDelay = 0, const size_t bufferSize = 0)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(numInputs == 0, false);
+        DISTRHO_SAFE_ASSERT_RETURN(newNumInputs != 0 && newNumInputs <= kMaxChannels, false);
+        DISTRHO_SAFE_ASSERT_RETURN(newNumOutputs != 0 && newNumOutputs <= kMaxChannels, false);
+
+        const ConvolutionKernel* const first = newKernels[0][0].get();
+        DISTRHO_SAFE_ASSERT_RETURN(first != nullptr, false);
+        DISTRHO_SAFE_ASSERT_RETURN(first->getNumStages() != 0, false);
+        DISTRHO_SAFE_ASSERT_RETURN(first->getNumStages() <= ConvolutionKernel::kMaxStages, false);
+
+        for (size_t o = 0; o < newNumOutputs; ++o)
+        {
+            for (size_t i = 0; i < newNumInputs; ++i)
+            {
+                const ConvolutionKernel* const kernel = newKernels[o][i].get();
+                if (kernel == nullptr)
+                    continue;
+                DISTRHO_SAFE_ASSERT_RETURN(kernel->getLayout() == first->getLayout(), false);
+                DISTRHO_SAFE_ASSERT_RETURN(kernel->getIRLength() == first->getIRLength(), false);
+                DISTRHO_SAFE_ASSERT_RETURN(kernel->getDelay() == first->getDelay(), false);
+            }
+        }
+
+        numInputs = newNumInputs;
+        numOutputs = newNumOutputs;
+
+        for (size_t o = 0; o < numOutputs; ++o)
+            for (size_t i = 0; i < numInputs; ++i)
+                kernels[o][i] = newKernels[o][i];
+
+        const ConvolutionKernel::Stage* stageKernels[kMaxChannels][kMaxChannels] = {};
+
+        // host buffers that do not line up with head blocks get a direct head, as long as its FIR stays short.
+        // it takes all of its pre-delay from the input history, so the FIR never reads back more than a block.
+        const size_t headBlockSize = first->getStage(0).blockSize;
+        const bool directHead = bufferSize != 0 && bufferSize % headBlockSize != 0 &&
+                                headBlockSize <= kMaxDirectHeadSize;
+
+        for (size_t s = 0; s < first->getNumStages(); ++s)
+        {
+            for (size_t o = 0; o < numOutputs; ++o)
+                for (size_t i = 0; i < numInputs; ++i)
+                    stageKernels[o][i] = kernels[o][i] != nullptr ? &kernels[o][i]->getStage(s) : nullptr;
+
+            if (s == 0)
+            {
+                headConvolver = new StageConvolver(stageKernels, numInputs, numOutputs,
+                                                   directHead ? 0 : newMaxPreDelay, directHead);
+                continue;
+            }
+
+           #ifndef DISTRHO_OS_WASM
+            stages[numBackgroundStages++] = new BackgroundStage(pool, stageKernels, numInputs, numOutputs,
+                                                                newMaxPreDelay, sampleRate, inlineTimeNs);
+           #else
+            stages[numBackgroundStages++] = new BackgroundStage(stageKernels, numInputs, numOutputs, newMaxPreDelay);
+           #endif
+        }
+
+        maxPreDelay = newMaxPreDelay;
+
+        if (maxPreDelay != 0)
+        {
+            // what is left after shifting is always less than a block, of the largest stage at most,
+            // except for a direct head which does not shift at all.
+            // stages take in at most a 1st background stage block at once, or a head block if there are none.
+            const size_t largestBlockSize = numBackgroundStages != 0 ? stages[numBackgroundStages - 1]->blockSize
+                                                                     : headConvolver->blockSize;
+            const size_t longestHistoryDelay = directHead ? maxPreDelay : std::min(largestBlockSize - 1, maxPreDelay);
+            const size_t chunkSize = numBackgroundStages != 0 ? stages[0]->blockSize : headConvolver->blockSize;
+
+            historySize = d_nextPowerOf2(static_cast<uint32_t>(longestHistoryDelay + 1 + chunkSize));
+
+            for (size_t i = 0; i < numInputs; ++i)
+            {
+                histories[i].resize(historySize);
+                headInputs[i].resize(chunkSize);
+            }
+        }
+
+        irLength = first->getIRLength();
+        delay = first->getDelay();
+
+        if (delay != 0)
+        {
+            for (size_t i = 0; i < numInputs; ++i)
+            {
+                delayLines[i].resize(delay);
+                delayedInputs[i].resize(headConvolver->blockSize);
+            }
+        }
+
+       #ifdef DISTRHO_OS_WASM
+        // unused
+        (void)sampleRate;
+       #endif
+
+        return true;
+    }
+
+    // like the above, but morphing from `fromKernels` into `toKernels` by an amount set with `setMorph`,
+    // starting at `morph`.
+    // both must share the same partition sizes, their lengths can differ and their onsets get aligned.
+    // paths can be null in one of them, and count as silence there.
+    bool initMorph(const std::shared_ptr<const ConvolutionKernel> fromKernels[kMaxChannels][kMaxChannels],
+                   const std::shared_ptr<const ConvolutionKernel> toKernels[kMaxChannels][kMaxChannels],
+                   const size_t newNumInputs, const size_t newNumOutputs, const double sampleRate,
+                   const size_t newMaxPreDelay, const size_t bufferSize, const float morph)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(numInputs == 0, false);
+        DISTRHO_SAFE_ASSERT_RETURN(newNumInputs != 0 && newNumInputs <= kMaxChannels, false);
+        DISTRHO_SAFE_ASSERT_RETURN(newNumOutputs != 0 && newNumOutputs <= kMaxChannels, false);
+        DISTRHO_SAFE_ASSERT_RETURN(fromKernels[0][0] != nullptr, false);
+
+        // all mixes need the same length, and use the delay of the 1st kernel
+        size_t mixLength = 0;
+
+        for (size_t o = 0; o < newNumOutputs; ++o)
+        {
+            for (size_t i = 0; i < newNumInputs; ++i)
+            {
+                if (fromKernels[o][i] != nullptr)
+                    mixLength = std::max(mixLength, fromKernels[o][i]->getIRLength());
+                if (toKernels[o][i] != nullptr)
+                    mixLength = std::max(mixLength, toKernels[o][i]->getIRLength());
+            }
+        }
+
+        std::shared_ptr<const ConvolutionKernel> mixes[kMaxChannels][kMaxChannels];
+
+        for (size_t o = 0; o < newNumOutputs; ++o)
+        {
+            for (size_t i = 0; i < newNumInputs; ++i)
+            {
+                morphFrom[o][i] = fromKernels[o][i];
+                morphTo[o][i] = toKernels[o][i];
+
+                if (morphFrom[o][i] == nullptr && morphTo[o][i] == nullptr)
+                    continue;
+
+                // paths with the same kernels in both (like the sides of a mono IR) share the same mix
+                for (size_t j = 0; j < o * kMaxChannels + i && morphMixes[o][i] == nullptr; ++j)
+                {
+                    if (morphFrom[j / kMaxChannels][j % kMaxChannels] == morphFrom[o][i] &&
+                        morphTo[j / kMaxChannels][j % kMaxChannels] == morphTo[o][i])
+                        morphMixes[o][i] = morphMixes[j / kMaxChannels][j % kMaxChannels];
+                }
+
+                if (morphMixes[o][i] == nullptr)
+                    morphMixes[o][i] = ConvolutionKernel::createBlend(morphFrom[o][i].get(), morphTo[o][i].get(),
+                                                                      morph, mixLength,
+                                                                      fromKernels[0][0]->getDelay());
+
+                DISTRHO_SAFE_ASSERT_RETURN(morphMixes[o][i] != nullptr, false);
+                mixes[o][i] = morphMixes[o][i];
+            }
+        }
+
+        if (! init(mixes, newNumInputs, newNumOutputs, sampleRate, newMaxPreDelay, bufferSize))
+            return false;
+
+        for (size_t s = 0; s < morphMixes[0][0]->getNumStages(); ++s)
+        {
+            StageConvolver& convolver(s == 0 ? *headConvolver : stages[s - 1]->convolver);
+
+            for (size_t o = 0; o < numOutputs; ++o)
+            {
+                for (size_t i = 0; i < numInputs; ++i)
+                {
+                    if (morphMixes[o][i] == nullptr)
+                        continue;
+
+                    const ConvolutionKernel* const from = morphFrom[o][i].get();
+                    const ConvolutionKernel* const to = morphTo[o][i].get();
+
+                    convolver.addMorphPath(&morphMixes[o][i]->getStage(s),
+                                           from != nullptr && s < from->getNumStages() ? &from->getStage(s) : nullptr,
+                                           to != nullptr && s < to->getNumStages() ? &to->getStage(s) : nullptr,
+                                           morph);
+                }
+            }
+
+            if (s != 0)
+                stages[s - 1]->pendingMorph = morph;
+        }
+
+        return true;
+    }
+
+    bool init(const std::shared_ptr<const ConvolutionKernel>& kernel, const double sampleRate,
+              const size_t bufferSize = 0)
+    {
+        const std::shared_ptr<const ConvolutionKernel> newKernels[kMaxChannels][kMaxChannels] = { { kernel } };
+        return init(newKernels, 1, 1, sampleRate, 0, bufferSize);
+    }
+
+    bool init(const fftconvolver::Sample* const ir, const size_t irLen, const double sampleRate)
+    {
+        return init(ConvolutionKernel::create(ir, irLen, ConvolutionLayout()), sampleRate);
+    }
+
+    // full length of the IR, including its delay
+    size_t getLength() const noexcept
+    {
+        return delay + irLength;
+    }
+
+   #ifndef DISTRHO_OS_WASM
+    // run background stages in the calling thread instead of the shared worker pool, adding their wall time to `timeNs`.
+    // for benchmarks, which must not compete with realtime convolvers. must be called before init.
+    void setRunInline(uint64_t* const timeNs) noexcept
+    {
+        inlineTimeNs = timeNs;
+    }
+
+    // record background job timing into `stats`, which must outlive this convolver.
+    // must not be called while processing.
+    void setStats(ConvolutionStats* const stats) noexcept
+    {
+        for (size_t s = 0; s < numBackgroundStages; ++s)
+            stages[s]->stats = stats;
+    }
+   #endif
+
+    // shorten the IR to `length` samples, including its delay.
+    // the partition where it ends is faded out, and those after it are not processed at all.
+    // to be called from the same thread as `process`.
+    void setLength(const size_t length) noexcept
+    {
+        // the last partition of a stage is usually not filled up, keep it as-is when not shortening at all
+        const size_t cut = length >= delay + irLength ? SIZE_MAX : length > delay ? length - delay : 0;
+        size_t limit;
+        float limitGain;
+
+        headConvolver->getLimit(cut, limit, limitGain);
+        headConvolver->setLimit(limit, limitGain);
+
+        // background stages pick it up on their next block
+        for (size_t s = 0; s < numBackgroundStages; ++s)
+            stages[s]->convolver.getLimit(cut, stages[s]->pendingLimit, stages[s]->pendingLimitGain);
+    }
+
+    // morph amount between the kernels given to `initMorph`, from 0 to 1.
+    // every stage mixes its kernels a few partitions at a time, so a change takes a few blocks of every stage.
+    // to be called from the same thread as `process`.
+    void setMorph(const float morph) noexcept
+    {
+        headConvolver->pendingMorph = morph;
+
+        for (size_t s = 0; s < numBackgroundStages; ++s)
+            stages[s]->pendingMorph = morph;
+    }
+
+    // delay the input by `preDelay` samples, up to the maximum given on init.
+    // every stage switches over at the start of its next block, so a change takes up to a block of the largest stage.
+    // to be called from the same thread as `process`.
+    void setPreDelay(size_t preDelay) noexcept
+    {
+        preDelay = std::min(preDelay, maxPreDelay);
+
+        headConvolver->getShift(preDelay, pendingHeadShift, pendingHeadHistoryDelay);
+
+        for (size_t s = 0; s < numBackgroundStages; ++s)
+            stages[s]->convolver.getShift(preDelay, stages[s]->pendingShift, stages[s]->pendingHistoryDelay);
+    }
+
+    void process(const fftconvolver::Sample* const* const inputs,
+                 fftconvolver::Sample* const* const outputs,
+                 const size_t len)
+    {
+        if (delay == 0)
+        {
+            processStages(inputs, outputs, len);
+            return;
+        }
+
+        const fftconvolver::Sample* ins[kMaxChannels];
+        fftconvolver::Sample* outs[kMaxChannels];
+
+        for (size_t processed = 0, processing; processed < len; processed += processing)
+        {
+            // split on head block boundaries, so no extra FFTs are needed
+            processing = std::min(len - processed, headConvolver->blockSize - headConvolver->inputBufferFill);
+
+            size_t position = delayPosition;
+
+            for (size_t i = 0; i < numInputs; ++i)
+            {
+                const fftconvolver::Sample* const in = inputs[i] + processed;
+                fftconvolver::Sample* const delayed = delayedInputs[i].data();
+                fftconvolver::Sample* const line = delayLines[i].data();
+
+                position = delayPosition;
+
+                for (size_t j = 0; j < processing; ++j)
+                {
+                    delayed[j] = line[position];
+                    line[position] = in[j];
+
+                    if (++position == delay)
+                        position = 0;
+                }
+
+                ins[i] = delayed;
+            }
+
+            delayPosition = position;
+
+            for (size_t o = 0; o < numOutputs; ++o)
+                outs[o] = outputs[o] + processed;
+
+            processStages(ins, outs, processing);
+        }
+    }
+
+    void process(const fftconvolver::Sample* const input, fftconvolver::Sample* const output, const size_t len)
+    {
+        process(&input, &output, len);
+    }
+
+private:
+    void processStages(const fftconvolver::Sample* const* const inputs,
+                       fftconvolver::Sample* const* const outputs,
+                       const size_t len)
+    {
+        if (numBackgroundStages == 0 && historySize == 0)
+        {
+            headConvolver->process(inputs, outputs, len);
+            return;
+        }
+
+        // all stage block sizes are multiples of the 1st one, split processing on its boundaries
+        const size_t firstStageBlockSize = numBackgroundStages != 0 ? stages[0]->blockSize : headConvolver->blockSize;
+
+        const fftconvolver::Sample* ins[kMaxChannels];
+        const fftconvolver::Sample* headIns[kMaxChannels];
+        fftconvolver::Sample* outs[kMaxChannels];
+
+        for (size_t processed = 0, processing; processed < len; processed += processing)
+        {
+            processing = numBackgroundStages != 0
+                       ? std::min(len - processed, firstStageBlockSize - stages[0]->inputFill)
+                       : std::min(len - processed, firstStageBlockSize - headConvolver->inputBufferFill);
+
+            if (historySize != 0)
+            {
+                // a pre-delay change waits for the head to start a new block, stop there so it does not wait long
+                if (headConvolver->inputBufferFill == 0)
+                {
+                    headHistoryDelay = pendingHeadHistoryDelay;
+                    headConvolver->pendingShift = pendingHeadShift;
+                }
+                else if (headHistoryDelay != pendingHeadHistoryDelay || headConvolver->shift != pendingHeadShift)
+                {
+                    processing = std::min(processing, headConvolver->blockSize - headConvolver->inputBufferFill);
+                }
+            }
+
+            for (size_t i = 0; i < numInputs; ++i)
+                ins[i] = inputs[i] + processed;
+            for (size_t o = 0; o < numOutputs; ++o)
+                outs[o] = outputs[o] + processed;
+
+            if (historySize != 0)
+                writeHistory(ins, processing);
+
+            if (headHistoryDelay != 0)
+            {
+                for (size_t i = 0; i < numInputs; ++i)
+                {
+                    readHistory(i, headHistoryDelay, headInputs[i].data(), processing);
+                    headIns[i] = headInputs[i].data();
+                }
+
+                headConvolver->process(headIns, outs, processing);
+            }
+            else
+            {
+                headConvolver->process(ins, outs, processing);
+            }
+
+            for (size_t s = 0; s < numBackgroundStages; ++s)
+            {
+                BackgroundStage* const stage = stages[s].get();
+
+                for (size_t o = 0; o < numOutputs; ++o)
+                {
+                    const fftconvolver::Sample* const precalculated = stage->getPrecalculated(o);
+
+                    if (precalculated == nullptr)
+                        continue;
+
+                    for (size_t i = 0; i < processing; ++i)
+                        outs[o][i] += precalculated[stage->inputFill + i];
+                }
+
+                if (stage->inputFill == 0)
+                {
+                    stage->historyDelay = stage->pendingHistoryDelay;
+                    stage->blockShift = stage->pendingShift;
+                    stage->inputSilent = true;
+                }
+
+                for (size_t i = 0; i < numInputs; ++i)
+                {
+                    fftconvolver::Sample* const stageInput = stage->inputs[i].data() + stage->inputFill;
+
+                    if (stage->historyDelay != 0)
+                        readHistory(i, stage->historyDelay, stageInput, processing);
+                    else
+                        std::memcpy(stageInput, ins[i], sizeof(fftconvolver::Sample) * processing);
+
+                    if (stage->inputSilent)
+                        stage->inputSilent = StageConvolver::isSilent(stageInput, processing);
+                }
+
+                stage->inputFill += processing;
+
+                if (stage->inputFill == stage->blockSize)
+                {
+                    stage->blockCompleted();
+                    stage->inputFill = 0;
+                }
+            }
+
+            if (historySize != 0)
+                historyPosition = (historyPosition + processing) & (historySize - 1);
+        }
+    }
+
+    // append to the input history, without moving its position yet
+    void writeHistory(const fftconvolver::Sample* const* const ins, const size_t len)
+    {
+        const size_t first = std::min(len, historySize - historyPosition);
+
+        for (size_t i = 0; i < numInputs; ++i)
+        {
+            std::memcpy(histories[i].data() + historyPosition, ins[i], sizeof(fftconvolver::Sample) * first);
+            std::memcpy(histories[i].data(), ins[i] + first, sizeof(fftconvolver::Sample) * (len - first));
+        }
+    }
+
+    // read `len` samples of input `input` from `historyDelay` samples before what was last written
+    void readHistory(const size_t input, const size_t historyDelay, fftconvolver::Sample* const dest,
+                     const size_t len) const
+    {
+        const size_t start = (historyPosition + historySize - historyDelay) & (historySize - 1);
+        const size_t first = std::min(len, historySize - start);
+        const fftconvolver::Sample* const history = histories[input].data();
+
+        std::memcpy(dest, history + start, sizeof(fftconvolver::Sample) * first);
+        std::memcpy(dest + first, history, sizeof(fftconvolver::Sample) * (len - first));
+    }
+
+    DISTRHO_DECLARE_NON_COPYABLE(MultiStageThreadedConvolver)
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+END_NAMESPACE_DISTRHO
@@ -21,27 +21,31 @@
 #include "OneKnobPlugin.hpp"
 #include "Korg35Filters.hpp"
 
-#include "Semaphore.hpp"
-#include "extra/ScopedPointer.hpp"
-#include "extra/Thread.hpp"
-
 #include "dr_flac.h"
 #include "dr_wav.h"
 // -Wunused-variable
 #include "r8brain/CDSPResampler.h"
 
 // must be last
-#include "TwoStageThreadedConvolver.hpp"
+#include "ConvolutionIRReader.hpp"
+#include "ConvolutionKernelCache.hpp"
+#include "ConvolutionKernelDiskCache.hpp"
+#include "ConvolutionKernelLoader.hpp"
+#include "ConvolutionKernelSet.hpp"
+#include "ConvolutionLateTail.hpp"
+#include "ConvolutionLayoutTuner.hpp"
 
 START_NAMESPACE_DISTRHO
 
 // -----------------------------------------------------------------------
 
-class OneKnobConvolutionReverbPlugin : public OneKnobPlugin
+class OneKnobConvolutionReverbPlugin : public OneKnobPlugin,
+                                       private ConvolutionKernelLoader::Client
 {
 public:
     OneKnobConvolutionReverbPlugin()
-        : OneKnobPlugin()
+        : OneKnobPlugin(),
+          loadTarget(new LoadTarget(this))
     {
         const float sampleRate = static_cast<float>(getSampleRate());
 
@@ -53,16 +57,37 @@ public:
 
         smoothDryLevel.setSampleRate(sampleRate);
         smoothWetLevel.setSampleRate(sampleRate);
+        smoothMorph.setSampleRate(sampleRate);
+
+        kernelSwapper.setSampleRate(sampleRate);
 
         smoothDryLevel.setTimeConstant(0.1f);
         smoothWetLevel.setTimeConstant(0.1f);
+        smoothMorph.setTimeConstant(0.1f);
+
+        stats.reset();
+       #ifndef DISTRHO_OS_WASM
+        kernelSwapper.setStats(&stats);
+       #endif
 
         smoothDryLevel.setTargetValue(std::pow(10.f, 0.05f * kParameterRanges[kParameterDryLevel].def));
         smoothWetLevel.setTargetValue(std::pow(10.f, 0.05f * kParameterRanges[kParameterWetLevel].def));
+        smoothMorph.setTargetValue(kParameterRanges[kParameterMorph].def * 0.01f);
+
+        // used directly while processing, must not start at 0 before the host sets it
+        parameters[kParameterLength] = kParameterRanges[kParameterLength].def;
+
+        loader->addClient(this);
     }
 
     ~OneKnobConvolutionReverbPlugin() override
     {
+        loader->removeClient(this);
+
+        // loads still in progress will finish after we are gone, make sure they do not touch us
+        const MutexLocker cml(loadTarget->mutex);
+        loadTarget->plugin = nullptr;
+        ++loadTarget->generation;
     }
 
 protected:
@@ -151,6 +176,77 @@ protected:
         case kParameterBypass:
             parameter.initDesignation(kParameterDesignationBypass);
             break;
+        case kParameterEfficientMode:
+            // not automatable, changing it reloads the IR
+            parameter.hints = kParameterIsInteger | kParameterIsBoolean;
+            parameter.name = "Efficient Mode";
+            parameter.symbol = "efficient";
+            parameter.description = "Convolve in larger blocks for lower CPU usage, at the cost of added latency";
+            parameter.ranges.def = kParameterRanges[kParameterEfficientMode].def;
+            parameter.ranges.min = kParameterRanges[kParameterEfficientMode].min;
+            parameter.ranges.max = kParameterRanges[kParameterEfficientMode].max;
+            break;
+        case kParameterLength:
+            parameter.hints = kParameterIsAutomatable;
+            parameter.name = "Length";
+            parameter.symbol = "length";
+            parameter.unit = "%";
+            parameter.description = "Shorten the IR tail, the part cut away is not processed at all";
+            parameter.ranges.def = kParameterRanges[kParameterLength].def;
+            parameter.ranges.min = kParameterRanges[kParameterLength].min;
+            parameter.ranges.max = kParameterRanges[kParameterLength].max;
+            break;
+        case kParameterPreDelay:
+            parameter.hints = kParameterIsAutomatable;
+            parameter.name = "Pre-Delay";
+            parameter.symbol = "predelay";
+            parameter.unit = "ms";
+            parameter.description = "Delay before the reverb starts";
+            parameter.ranges.def = kParameterRanges[kParameterPreDelay].def;
+            parameter.ranges.min = kParameterRanges[kParameterPreDelay].min;
+            parameter.ranges.max = kParameterRanges[kParameterPreDelay].max;
+            break;
+        case kParameterCompactKernels:
+            // not automatable, changing it reloads the IR
+            parameter.hints = kParameterIsInteger | kParameterIsBoolean;
+            parameter.name = "Compact Kernels";
+            parameter.symbol = "compact";
+            parameter.description = "Store the IR spectra at half precision, for less memory use with long IRs "
+                                    "at the cost of some accuracy";
+            parameter.ranges.def = kParameterRanges[kParameterCompactKernels].def;
+            parameter.ranges.min = kParameterRanges[kParameterCompactKernels].min;
+            parameter.ranges.max = kParameterRanges[kParameterCompactKernels].max;
+            break;
+        case kParameterLateTail:
+            // not automatable, changing it reloads the IR
+            parameter.hints = kParameterIsInteger | kParameterIsBoolean;
+            parameter.name = "Algorithmic Tail";
+            parameter.symbol = "algotail";
+            parameter.description = "Convolve only the start of the IR and replace the rest with a matching "
+                                    "algorithmic reverb, for the same CPU and memory use with IRs of any length";
+            parameter.ranges.def = kParameterRanges[kParameterLateTail].def;
+            parameter.ranges.min = kParameterRanges[kParameterLateTail].min;
+            parameter.ranges.max = kParameterRanges[kParameterLateTail].max;
+            break;
+        case kParameterMorph:
+            parameter.hints = kParameterIsAutomatable;
+            parameter.name = "Morph";
+            parameter.symbol = "morph";
+            parameter.unit = "%";
+            parameter.description = "Blend from the IR file into the morph IR file, if one is loaded";
+            parameter.ranges.def = kParameterRanges[kParameterMorph].def;
+            parameter.ranges.min = kParameterRanges[kParameterMorph].min;
+            parameter.ranges.max = kParameterRanges[kParameterMorph].max;
+            break;
+        case kParameterLoadProgress:
+            parameter.hints = kParameterIsOutput;
+            parameter.name = "IR Load Progress";
+            parameter.symbol = "loadprogress";
+            parameter.unit = "%";
+            parameter.ranges.def = kParameterRanges[kParameterLoadProgress].def;
+            parameter.ranges.min = kParameterRanges[kParameterLoadProgress].min;
+            parameter.ranges.max = kParameterRanges[kParameterLoadProgress].max;
+            break;
         }
     }
 
@@ -176,12 +272,42 @@ protected:
             state.fileTypes = "ir";
            #endif
             break;
+        case kStateMorphFile:
+            state.hints = kStateIsFilenamePath;
+            state.key = "irmorphfile";
+            state.label = "Morph IR File";
+            state.description = "Second IR to morph into with the Morph parameter, "
+                                "the algorithmic tail is not used while one is loaded";
+           #ifdef __MOD_DEVICES__
+            state.fileTypes = "ir";
+           #endif
+            break;
+        case kStateTrimReport:
+            state.hints = kStateIsHostReadable | kStateIsOnlyForDSP;
+            state.key = "irtrim";
+            state.label = "IR Trimming Report";
+            state.description = "How much of the IR was trimmed as silence, and the partitions saved by it";
+            break;
+        case kStateStats:
+            state.hints = kStateIsHostReadable | kStateIsOnlyForDSP;
+            state.key = "convstats";
+            state.label = "Convolution Stats";
+            state.description = "Background job timing, and how often the audio thread had to wait for a job";
+            break;
         }
     }
 
     // -------------------------------------------------------------------
     // Internal data
 
+    float getParameterValue(const uint32_t index) const override
+    {
+        if (index == kParameterLoadProgress)
+            return loadTarget->progress.load() * 100.f;
+
+        return OneKnobPlugin::getParameterValue(index);
+    }
+
     void setParameterValue(const uint32_t index, const float value) override
     {
         switch (index)
@@ -218,6 +344,23 @@ protected:
                 smoothWetLevel.setTargetValue(std::pow(10.f, 0.05f * parameters[kParameterWetLevel]));
             }
             break;
+        // might be called from the audio thread, the reload is left to the loader
+        case kParameterEfficientMode:
+            if (efficientMode.exchange(value > 0.5f) != (value > 0.5f))
+                loader->requestPoll(this);
+            break;
+        case kParameterCompactKernels:
+            if (compactKernels.exchange(value > 0.5f) != (value > 0.5f))
+                loader->requestPoll(this);
+            break;
+        case kParameterLateTail:
+            if (lateTail.exchange(value > 0.5f) != (value > 0.5f))
+                loader->requestPoll(this);
+            break;
+        case kParameterMorph:
+            smoothMorph.setTargetValue(value * 0.01f);
+            loadMorph.store(value * 0.01f);
+            break;
         }
 
         OneKnobPlugin::setParameterValue(index, value);
@@ -237,120 +380,68 @@ protected:
 
         smoothDryLevel.clearToTargetValue();
         smoothWetLevel.clearToTargetValue();
+        smoothMorph.clearToTargetValue();
     }
 
     void setState(const char* const key, const char* const value) override
     {
         if (std::strcmp(key, "irfile") == 0)
         {
-            unsigned int channels;
-            unsigned int sampleRate;
-            drwav_uint64 numFrames;
-            const size_t valuelen = std::strlen(value);
-
-            ScopedPointer<TwoStageThreadedConvolver> newConvolverL, newConvolverR;
-
-            if (valuelen <= 5)
-            {
-                const MutexLocker cml(mutex);
-                convolverL.swapWith(newConvolverL);
-                convolverR.swapWith(newConvolverR);
-                return;
-            }
-
-            float* ir;
-            if (::strncasecmp(value + (std::max(size_t(0), valuelen - 5u)), ".flac", 5) == 0)
-                ir = drflac_open_file_and_read_pcm_frames_f32(value, &channels, &sampleRate, &numFrames, nullptr);
-            else
-                ir = drwav_open_file_and_read_pcm_frames_f32(value, &channels, &sampleRate, &numFrames, nullptr);
-            DISTRHO_SAFE_ASSERT_RETURN(ir != nullptr,);
-
-            loadedFilename = value;
+            const MutexLocker cml(loadTarget->mutex);
+            loadedFilename = std::strlen(value) > 5 ? value : "";
+            loadedSampleRate = getSampleRate();
+            loadedBufferSize = getBufferSize();
+            loadFile();
+            return;
+        }
 
-            float* irBufL;
-            float* irBufR;
-            switch (channels)
-            {
-            case 1:
-                irBufL = irBufR = ir;
-                break;
-            case 2:
-                irBufL = new float[numFrames];
-                irBufR = new float[numFrames];
-                for (drwav_uint64 i = 0, j = 0; i < numFrames; ++i)
-                {
-                    irBufL[i] = ir[j++];
-                    irBufR[i] = ir[j++];
-                }
-                break;
-            case 4:
-                irBufL = new float[numFrames];
-                irBufR = new float[numFrames];
-                for (drwav_uint64 i = 0, j = 0; i < numFrames; ++i, j += 4)
-                {
-                    irBufL[i] = ir[j + 0] + ir[j + 2];
-                    irBufR[i] = ir[j + 1] + ir[j + 3];
-                }
-                break;
-            default:
-                irBufL = new float[numFrames];
-                irBufR = new float[numFrames];
-                for (drwav_uint64 i = 0, j = 0; i < numFrames; ++i)
-                {
-                    irBufL[i] = irBufR[i] = ir[j];
-                    j += channels;
-                }
-                break;
-            }
+        // morphing needs both IRs in the same set, so it always reloads the 1st one too
+        if (std::strcmp(key, "irmorphfile") == 0)
+        {
+            const MutexLocker cml(loadTarget->mutex);
+            morphFilename = std::strlen(value) > 5 ? value : "";
 
-            if (sampleRate != getSampleRate())
-            {
-                r8b::CDSPResampler16IR resampler(sampleRate, getSampleRate(), numFrames);
-                const int numResampledFrames = resampler.getMaxOutLen(0);
-                DISTRHO_SAFE_ASSERT_RETURN(numResampledFrames > 0,);
-
-                // left channel, always present
-                float* const irBufResampledL = new float[numResampledFrames];
-                resampler.oneshot(irBufL, numFrames, irBufResampledL, numResampledFrames);
-                if (irBufL != ir)
-                    delete[] irBufL;
-                irBufL = irBufResampledL;
-
-                // right channel, optional
-                if (irBufL != irBufR)
-                {
-                    float* const irBufResampledR = new float[numResampledFrames];
-                    resampler.oneshot(irBufR, numFrames, irBufResampledR, numResampledFrames);
-                    if (irBufR != ir)
-                        delete[] irBufR;
-                    irBufR = irBufResampledR;
-                }
+            if (loadedFilename.isNotEmpty())
+                loadFile();
+            return;
+        }
 
-                numFrames = numResampledFrames;
-            }
+        // read-only, reports from an older session coming back to us
+        if (std::strcmp(key, "irtrim") == 0 || std::strcmp(key, "convstats") == 0)
+            return;
 
-            newConvolverL = new TwoStageThreadedConvolver();
-            newConvolverL->init(irBufL, numFrames);
+        OneKnobPlugin::setState(key, value);
+    }
 
-            newConvolverR = new TwoStageThreadedConvolver();
-            newConvolverR->init(irBufR, numFrames);
+    String getState(const char* const key) const override
+    {
+        if (std::strcmp(key, "irfile") == 0)
+        {
+            const MutexLocker cml(loadTarget->mutex);
+            return loadedFilename;
+        }
 
-            {
-                const MutexLocker cml(mutex);
-                convolverL.swapWith(newConvolverL);
-                convolverR.swapWith(newConvolverR);
-            }
+        if (std::strcmp(key, "irmorphfile") == 0)
+        {
+            const MutexLocker cml(loadTarget->mutex);
+            return morphFilename;
+        }
 
-            if (irBufL != ir)
-                delete[] irBufL;
-            if (irBufR != irBufL)
-                delete[] irBufR;
+        if (std::strcmp(key, "irtrim") == 0)
+        {
+            char report[192];
+            stats.formatLoad(report, sizeof(report));
+            return String(report);
+        }
 
-            drwav_free(ir, nullptr);
-            return;
+        if (std::strcmp(key, "convstats") == 0)
+        {
+            char report[256];
+            stats.format(report, sizeof(report));
+            return String(report);
         }
 
-        OneKnobPlugin::setState(key, value);
+        return String();
     }
 
     // -------------------------------------------------------------------
@@ -365,11 +456,35 @@ protected:
         inplaceProcBufL = new float[bufSize];
         inplaceProcBufR = new float[bufSize];
 
+        kernelSwapper.setBufferSize(bufSize);
+        loadTarget->active.store(true);
+
+        dryDelaySize = getEfficientHeadBlockSize(bufSize);
+        dryDelayBufL = new float[dryDelaySize];
+        dryDelayBufR = new float[dryDelaySize];
+        std::memset(dryDelayBufL, 0, sizeof(float) * dryDelaySize);
+        std::memset(dryDelayBufR, 0, sizeof(float) * dryDelaySize);
+        dryDelayPosition = 0;
+
+        // the partition layout, how the head is done and the efficient mode block size all depend on the buffer size
+        {
+            const MutexLocker cml(loadTarget->mutex);
+
+            if (loadedBufferSize != bufSize)
+            {
+                loadedBufferSize = bufSize;
+
+                if (loadedFilename.isNotEmpty())
+                    loadFile();
+            }
+        }
+
         korgFilterL.reset();
         korgFilterR.reset();
 
         smoothDryLevel.clearToTargetValue();
         smoothWetLevel.clearToTargetValue();
+        smoothMorph.clearToTargetValue();
 
         OneKnobPlugin::activate();
     }
@@ -380,9 +495,15 @@ protected:
         delete[] highpassBufR;
         delete[] inplaceProcBufL;
         delete[] inplaceProcBufR;
+        delete[] dryDelayBufL;
+        delete[] dryDelayBufR;
+        kernelSwapper.setBufferSize(0);
+        loadTarget->active.store(false);
         bufferSize = 0;
         highpassBufL = highpassBufR = nullptr;
         inplaceProcBufL = inplaceProcBufR = nullptr;
+        dryDelayBufL = dryDelayBufR = nullptr;
+        dryDelaySize = 0;
     }
 
     void run(const float** const inputs, float** const outputs, const uint32_t frames) override
@@ -402,6 +523,12 @@ protected:
 
         for (uint32_t offset = 0; offset < frames; offset += bufferSize)
             run(inputs, outputs, std::min(frames - offset, bufferSize), offset);
+
+        setSharedStats(stats);
+
+        // used for prioritizing IR loads
+        loadTarget->lastRunTime.store(ConvolutionKernelLoader::getTimeMs(), std::memory_order_relaxed);
+        loadTarget->visible.store(lineGraphActive, std::memory_order_relaxed);
     }
 
     void run(const float** const inputs, float** const outputs, const uint32_t frames, const uint32_t offset)
@@ -450,64 +577,66 @@ protected:
         float tmp2 = lineGraphHighest2;
        #endif
 
-        const MutexTryLocker cmtl(mutex);
+        // kernels are only mixed again every few blocks, smoothing keeps the steps between mixes small
+        float morph = 0.f;
+        for (uint32_t i = 0; i < frames; ++i)
+            morph = smoothMorph.next();
 
-        if (cmtl.wasLocked())
-        {
-            TwoStageThreadedConvolver* const convL = convolverL.get();
-            TwoStageThreadedConvolver* const convR = convolverR.get();
+        kernelSwapper.setLength(parameters[kParameterLength] * 0.01f);
+        kernelSwapper.setMorph(morph);
+        kernelSwapper.setPreDelay(static_cast<uint32_t>(parameters[kParameterPreDelay] * 0.001 * getSampleRate() + 0.5));
 
-            if (convL != nullptr && convR != nullptr)
-            {
-                convL->process(highpassBufL, outL, frames);
-                convR->process(highpassBufR, outR, frames);
+        const bool processed = kernelSwapper.process(highpassBufL, highpassBufR, outL, outR, frames);
 
-                for (uint32_t i = 0; i < frames; ++i)
-                {
-                    dryLevel = smoothDryLevel.next();
-                    wetLevel = smoothWetLevel.next();
+        delayDry(dryBufL, dryBufR, frames);
 
-                    if (wetLevel <= 0.001f)
-                    {
-                        outL[i] = outR[i] = 0.f;
-                    }
-                    else
-                    {
-                        outL[i] *= wetLevel;
-                        outR[i] *= wetLevel;
-                       #ifdef HAVE_OPENGL
-                        tmp2 = std::max(tmp2, std::abs(outL[i]));
-                        tmp2 = std::max(tmp2, std::abs(outR[i]));
-                       #endif
-                    }
+        if (processed)
+        {
+            for (uint32_t i = 0; i < frames; ++i)
+            {
+                dryLevel = smoothDryLevel.next();
+                wetLevel = smoothWetLevel.next();
 
-                    if (dryLevel > 0.001f)
-                    {
-                        outL[i] += dryBufL[i] * dryLevel;
-                        outR[i] += dryBufR[i] * dryLevel;
-                       #ifdef HAVE_OPENGL
-                        tmp1 = std::max(tmp1, std::abs(dryBufL[i] * dryLevel));
-                        tmp1 = std::max(tmp1, std::abs(dryBufR[i] * dryLevel));
-                       #endif
-                    }
+                if (wetLevel <= 0.001f)
+                {
+                    outL[i] = outR[i] = 0.f;
+                }
+                else
+                {
+                    outL[i] *= wetLevel;
+                    outR[i] *= wetLevel;
+                   #ifdef HAVE_OPENGL
+                    tmp2 = std::max(tmp2, std::abs(outL[i]));
+                    tmp2 = std::max(tmp2, std::abs(outR[i]));
+                   #endif
+                }
 
+                if (dryLevel > 0.001f)
+                {
+                    outL[i] += dryBufL[i] * dryLevel;
+                    outR[i] += dryBufR[i] * dryLevel;
                    #ifdef HAVE_OPENGL
-                    if (++lineGraphFrameCounter == lineGraphFrameToReset)
-                    {
-                        lineGraphFrameCounter = 0;
-                        setMeters(tmp1, tmp2);
-                        tmp1 = tmp2 = 0.f;
-                    }
+                    tmp1 = std::max(tmp1, std::abs(dryBufL[i] * dryLevel));
+                    tmp1 = std::max(tmp1, std::abs(dryBufR[i] * dryLevel));
                    #endif
                 }
 
                #ifdef HAVE_OPENGL
-                lineGraphHighest1 = tmp1;
-                lineGraphHighest2 = tmp2;
+                if (++lineGraphFrameCounter == lineGraphFrameToReset)
+                {
+                    lineGraphFrameCounter = 0;
+                    setMeters(tmp1, tmp2);
+                    tmp1 = tmp2 = 0.f;
+                }
                #endif
-
-                return;
             }
+
+           #ifdef HAVE_OPENGL
+            lineGraphHighest1 = tmp1;
+            lineGraphHighest2 = tmp2;
+           #endif
+
+            return;
         }
 
         for (uint32_t i = 0; i < frames; ++i)
@@ -544,30 +673,647 @@ protected:
 
         smoothDryLevel.setSampleRate(newSampleRate);
         smoothWetLevel.setSampleRate(newSampleRate);
+        smoothMorph.setSampleRate(newSampleRate);
 
-        // reload file
-        if (char* const filename = loadedFilename.getAndReleaseBuffer())
-        {
-            setState("irfile", filename);
-            std::free(filename);
-        }
+        kernelSwapper.setSampleRate(newSampleRate);
+
+        const MutexLocker cml(loadTarget->mutex);
+        loadedSampleRate = newSampleRate;
+
+        if (loadedFilename.isNotEmpty())
+            loadFile();
     }
 
   // -------------------------------------------------------------------
 
 private:
-    ScopedPointer<TwoStageThreadedConvolver> convolverL, convolverR;
+    // smallest head block used in efficient mode
+    static constexpr const uint32_t kEfficientHeadBlockSize = 1024;
+
+    // how much of the IR gets convolved when replacing the rest with an algorithmic tail, in ms,
+    // and how long it takes to fade out while the tail builds up
+    static constexpr const float kLateTailCrossover = 150.f;
+    static constexpr const float kLateTailCrossfade = 60.f;
+
+    static uint32_t getEfficientHeadBlockSize(const uint32_t bufSize) noexcept
+    {
+        return std::max(kEfficientHeadBlockSize, d_nextPowerOf2(bufSize));
+    }
+
+    // start loading the current IR files with the current settings in the background, or unload if there are none.
+    // the decoded IRs are still in memory when only the settings changed, so that is quick.
+    // must be called with the load target mutex locked.
+    void loadFile()
+    {
+        const uint32_t generation = ++loadTarget->generation;
+
+        if (loadedFilename.isEmpty())
+        {
+            loadTarget->progress.store(1.f);
+            kernelSwapper.publish(nullptr);
+            return;
+        }
+
+        loadTarget->progress.store(0.f);
+
+        // efficient mode convolves whole blocks of at least the host buffer size, reported as latency
+        const uint32_t latency = efficientMode.load() ? getEfficientHeadBlockSize(loadedBufferSize) : 0;
+
+        // decoding, resampling and partitioning happens in the background, the result is installed when ready
+        loader->submitJob(new LoadJob(loader.loader, loadTarget, loadedFilename, morphFilename, loadedSampleRate,
+                                      loadedBufferSize, latency, compactKernels.load(), lateTail.load(),
+                                      loadMorph.load(), generation));
+    }
+
+    // a setting the kernels depend on was changed, from a thread we could not load from
+    void poll() override
+    {
+        const MutexLocker cml(loadTarget->mutex);
+
+        if (loadedFilename.isNotEmpty())
+            loadFile();
+    }
+
+    // delay the dry signal by the latency of the convolution, so both stay aligned
+    void delayDry(const float*& dryBufL, const float*& dryBufR, const uint32_t frames)
+    {
+        const uint32_t latency = kernelSwapper.getLatency();
+
+        if (latency != reportedLatency)
+        {
+            reportedLatency = latency;
+            setLatency(latency);
+
+            std::memset(dryDelayBufL, 0, sizeof(float) * dryDelaySize);
+            std::memset(dryDelayBufR, 0, sizeof(float) * dryDelaySize);
+            dryDelayPosition = 0;
+        }
+
+        // a set made for a previous buffer size can be left running for a moment, best we can do is skip the delay
+        if (latency == 0 || latency > dryDelaySize)
+            return;
+
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            const float dryL = dryBufL[i];
+            const float dryR = dryBufR[i];
+            inplaceProcBufL[i] = dryDelayBufL[dryDelayPosition];
+            inplaceProcBufR[i] = dryDelayBufR[dryDelayPosition];
+            dryDelayBufL[dryDelayPosition] = dryL;
+            dryDelayBufR[dryDelayPosition] = dryR;
+
+            if (++dryDelayPosition == latency)
+                dryDelayPosition = 0;
+        }
+
+        dryBufL = inplaceProcBufL;
+        dryBufR = inplaceProcBufR;
+    }
+
+    // higher priorities are loaded first
+    enum LoadPriority {
+        kLoadPriorityInactive,
+        kLoadPriorityActive,
+        kLoadPriorityPlaying,
+        kLoadPriorityVisible,
+        kLoadPriorityChannel
+    };
+
+    // shared between the plugin and its load jobs, which might outlive the plugin
+    struct LoadTarget {
+        Mutex mutex;
+        OneKnobConvolutionReverbPlugin* plugin;
+        std::atomic<uint32_t> generation;
+        std::atomic<float> progress;
+
+        // used for prioritizing loads
+        std::atomic<bool> active;
+        std::atomic<bool> visible;
+        std::atomic<int64_t> lastRunTime;
+
+        LoadTarget(OneKnobConvolutionReverbPlugin* const p)
+            : plugin(p),
+              generation(0),
+              progress(1.f),
+              active(false),
+              visible(false),
+              lastRunTime(0) {}
+
+        // returns false if a newer load has been requested since
+        bool setProgress(const uint32_t gen, const float value)
+        {
+            if (generation.load() != gen)
+                return false;
+
+            progress.store(value);
+            return true;
+        }
+    };
+
+    // resample and partition the trimmed region of a single decoded IR channel, one chunk at a time
+    struct ChannelJob : ConvolutionKernelLoader::Job {
+        static constexpr const size_t kChunkFrames = 4096;
+
+        const uint channel;
+        const double targetSampleRate;
+        const ConvolutionLayout& layout;
+        const ConvolutionKernelCache::Source& source;
+        std::shared_ptr<const ConvolutionKernel> kernel;
+
+        ChannelJob(const uint channel_, const double targetSampleRate_,
+                   const ConvolutionLayout& layout_, const ConvolutionKernelCache::Source& source_)
+            : ConvolutionKernelLoader::Job(),
+              channel(channel_),
+              targetSampleRate(targetSampleRate_),
+              layout(layout_),
+              source(source_) {}
+
+        int getPriority() const override
+        {
+            // other half of a load already in progress, always comes first
+            return kLoadPriorityChannel;
+        }
+
+        void runJob() override
+        {
+            const ConvolutionTrimmer::Region& region(source.region);
+            const std::vector<float>& input(source.channels[channel]);
+            const size_t numFrames = source.numFrames;
+            const double sourceSampleRate = source.sampleRate;
+
+            // resampling starts from the trimmed region, the onset is rounded to the nearest output sample
+            const size_t length = region.end - region.start;
+            const bool resampling = ! d_isEqual(sourceSampleRate, targetSampleRate);
+            const double ratio = resampling ? targetSampleRate / sourceSampleRate : 1.0;
+            const size_t delay = resampling ? static_cast<size_t>(region.start * ratio + 0.5) : region.start;
+            const size_t untrimmedLength = resampling ? static_cast<size_t>(std::ceil(numFrames * ratio)) : numFrames;
+            const ConvolutionTrimmer::Region relative = { 0, length, region.fadeStart - region.start };
+            const ConvolutionTrimmer::Region trimmed = ConvolutionTrimmer::scale(
+                relative, resampling ? static_cast<size_t>(std::ceil(length * ratio)) : length, ratio);
+
+            ConvolutionKernel::Builder builder(layout, trimmed.end, delay, untrimmedLength);
+            ScopedPointer<r8b::CDSPResampler16IR> resampler;
+            std::vector<float> samples(kChunkFrames);
+            std::vector<double> resamplerInput;
+            size_t inputPosition = 0;
+            size_t position = 0;
+
+            if (resampling)
+            {
+                resampler = new r8b::CDSPResampler16IR(sourceSampleRate, targetSampleRate, kChunkFrames);
+                resamplerInput.resize(kChunkFrames);
+                samples.resize(std::max<size_t>(kChunkFrames, resampler->getMaxOutLen(0)));
+            }
+
+            while (position < trimmed.end)
+            {
+                // the file might have ended early, the decoded channel is what counts
+                const size_t frames = std::min(kChunkFrames, std::min(length, input.size()) - inputPosition);
+
+                if (frames != 0)
+                    std::memcpy(samples.data(), input.data() + inputPosition, sizeof(float) * frames);
+
+                inputPosition += frames;
+
+                if (! resampling)
+                {
+                    if (frames == 0)
+                        break;
+
+                    write(builder, trimmed, samples.data(), frames, position);
+                    continue;
+                }
+
+                // once the region is over keep feeding silence, until the resampler has flushed the tail we need
+                if (frames != 0)
+                {
+                    for (size_t i = 0; i < frames; ++i)
+                        resamplerInput[i] = samples[i];
+                }
+                else
+                {
+                    std::fill(resamplerInput.begin(), resamplerInput.end(), 0.0);
+                }
+
+                double* output;
+                const int numOutput = resampler->process(resamplerInput.data(),
+                                                         static_cast<int>(frames != 0 ? frames : kChunkFrames),
+                                                         output);
+
+                for (int i = 0; i < numOutput; ++i)
+                    samples[i] = static_cast<float>(output[i]);
+
+                write(builder, trimmed, samples.data(), numOutput, position);
+            }
+
+            kernel = builder.finish();
+        }
+
+        // pass along the part of `count` samples at IR `position` which falls inside the trimmed region
+        static void write(ConvolutionKernel::Builder& builder, const ConvolutionTrimmer::Region& trimmed,
+                          float* const buffer, const size_t count, size_t& position)
+        {
+            const size_t first = std::max(position, trimmed.start);
+            const size_t last = std::min(position + count, trimmed.end);
+
+            if (first < last)
+            {
+                float* const inside = buffer + (first - position);
+                ConvolutionTrimmer::applyFadeOut(inside, first, last - first, trimmed);
+                builder.write(inside, last - first);
+            }
+
+            position += count;
+        }
+
+        DISTRHO_DECLARE_NON_COPYABLE(ChannelJob)
+    };
+
+    // load an IR file into a new kernel set and install it, owned by the loader.
+    // with a morph file both are loaded with the same layout, and the set morphs between them.
+    struct LoadJob : ConvolutionKernelLoader::Job {
+        ConvolutionKernelLoader* const loader;
+        const std::shared_ptr<LoadTarget> target;
+        const String filename;
+        const String morphFilename;
+        const double sampleRate;
+        const uint32_t bufferSize;
+        const uint32_t latency;
+        const bool compact;
+        const bool lateTail;
+        const float morph;
+        const uint32_t generation;
+        ConvolutionLayout layout;
+
+        LoadJob(ConvolutionKernelLoader* const loader_, const std::shared_ptr<LoadTarget>& target_,
+                const char* const filename_, const char* const morphFilename_, const double sampleRate_,
+                const uint32_t bufferSize_, const uint32_t latency_, const bool compact_, const bool lateTail_,
+                const float morph_, const uint32_t generation_)
+            : ConvolutionKernelLoader::Job(true),
+              loader(loader_),
+              target(target_),
+              filename(filename_),
+              morphFilename(morphFilename_),
+              sampleRate(sampleRate_),
+              bufferSize(bufferSize_),
+              latency(latency_),
+              compact(compact_),
+              lateTail(lateTail_),
+              morph(morph_),
+              generation(generation_) {}
+
+        int getPriority() const override
+        {
+            if (target->visible.load())
+                return kLoadPriorityVisible;
+            if (! target->active.load())
+                return kLoadPriorityInactive;
+            if (ConvolutionKernelLoader::getTimeMs() - target->lastRunTime.load() < 1000)
+                return kLoadPriorityPlaying;
+            return kLoadPriorityActive;
+        }
+
+        void runJob() override
+        {
+            // skip loads that were superseded while waiting in the queue
+            if (target->generation.load() != generation)
+                return;
+
+            // the algorithmic tail is made for a single IR, a morph convolves both in full
+            const bool morphing = morphFilename.isNotEmpty();
+            const bool withLateTail = lateTail && ! morphing;
+            ConvolutionTrimSettings trim;
+
+            if (withLateTail)
+            {
+                trim.maxLength = kLateTailCrossover;
+                trim.fadeLength = kLateTailCrossfade;
+            }
+
+            ConvolutionKernelCache::Kernels kernels;
+            ConvolutionKernelCache::Kernels morphKernels;
+
+            // files are opened only once, and only decoded if the kernels are not cached
+            ConvolutionIRReader reader;
+            ConvolutionIRReader morphReader;
+
+            // the partition layout depends on how this machine copes with the buffer size and IR length,
+            // efficient mode keeps its head block fixed to the latency
+            {
+                size_t irLength = openIR(filename, reader);
+
+                if (morphing)
+                    irLength = std::max(irLength, openIR(morphFilename, morphReader));
+
+                if (withLateTail)
+                    irLength = std::min(irLength, static_cast<size_t>(
+                        std::ceil((trim.maxLength + trim.fadeLength) * 0.001 * sampleRate)));
+
+                if (irLength != 0)
+                    layout = ConvolutionLayoutTuner::getInstance().getLayout(bufferSize, latency,
+                                                                             irLength, sampleRate);
+            }
+
+            layout.compactSpectra = compact;
+
+            if (! getKernels(filename, reader, trim, kernels))
+            {
+                target->setProgress(generation, 1.f);
+                return;
+            }
+
+            // a morph file failing to load leaves the 1st one on its own
+            const bool morphed = morphing && getKernels(morphFilename, morphReader, trim, morphKernels);
+
+            ConvolutionKernelSet* const kernelSet = new ConvolutionKernelSet();
+            kernelSet->source = kernels.source;
+            kernelSet->morphSource = morphKernels.source;
+            kernelSet->setLatency(latency);
+
+            // cross-channel kernels are null unless loading a true stereo IR
+            const std::shared_ptr<const ConvolutionKernel> matrix[2][2] = {
+                { kernels.left, kernels.rightToLeft },
+                { kernels.leftToRight, kernels.right }
+            };
+            const std::shared_ptr<const ConvolutionKernel> morphMatrix[2][2] = {
+                { morphKernels.left, morphKernels.rightToLeft },
+                { morphKernels.leftToRight, morphKernels.right }
+            };
+
+            kernelSet->convolver = new MultiStageThreadedConvolver();
+
+            // room for the longest pre-delay, done by the convolver without any extra delay line
+            const size_t maxPreDelay = static_cast<size_t>(
+                std::ceil(kParameterRanges[kParameterPreDelay].max * 0.001 * sampleRate));
+
+            if (! (morphed ? kernelSet->convolver->initMorph(matrix, morphMatrix, 2, 2, sampleRate, maxPreDelay,
+                                                             bufferSize, morph)
+                           : kernelSet->convolver->init(matrix, 2, 2, sampleRate, maxPreDelay, bufferSize)))
+                kernelSet->convolver = nullptr;
+
+            // takes over where the convolved part of the IR fades out
+            if (kernels.lateTail.isEnabled())
+            {
+                kernelSet->lateTail = new ConvolutionLateTail();
+
+                if (! kernelSet->lateTail->init(kernels.lateTail, sampleRate, maxPreDelay, kernels.isTrueStereo()))
+                    kernelSet->lateTail = nullptr;
+            }
+
+            const MutexLocker cml(target->mutex);
+
+            if (target->plugin != nullptr && target->setProgress(generation, 1.f))
+            {
+                target->plugin->kernelSwapper.publish(kernelSet);
+                reportTrimming(target->plugin->stats, kernels, morphed ? &morphKernels : nullptr);
+            }
+            else
+            {
+                delete kernelSet;
+            }
+        }
+
+        // all kernels of a file share the same trimming, so reporting one of them is enough.
+        // the UI and the "irtrim" state pick it up from the stats, the host is never called from here.
+        void reportTrimming(ConvolutionStats& stats, const ConvolutionKernelCache::Kernels& kernels,
+                            const ConvolutionKernelCache::Kernels* const morphKernels) const
+        {
+            const ConvolutionKernel* const kernel = kernels.left.get();
+            const ConvolutionKernel* const morphKernel = morphKernels != nullptr ? morphKernels->left.get() : nullptr;
+            const size_t untrimmedPartitions = ConvolutionKernel::countPartitions(kernel->getUntrimmedLength(), layout);
+
+            stats.irDelay.store(static_cast<uint32_t>(kernel->getDelay()), std::memory_order_relaxed);
+            stats.irLength.store(static_cast<uint32_t>(kernel->getIRLength()), std::memory_order_relaxed);
+            stats.irUntrimmedLength.store(static_cast<uint32_t>(kernel->getUntrimmedLength()),
+                                          std::memory_order_relaxed);
+            stats.irPartitions.store(static_cast<uint32_t>(kernel->getNumPartitions()), std::memory_order_relaxed);
+            stats.irUntrimmedPartitions.store(static_cast<uint32_t>(untrimmedPartitions), std::memory_order_relaxed);
+            stats.irActivePartitions.store(static_cast<uint32_t>(kernel->getNumActivePartitions()),
+                                           std::memory_order_relaxed);
+
+            stats.morphLength.store(morphKernel != nullptr ? static_cast<uint32_t>(morphKernel->getIRLength()) : 0,
+                                    std::memory_order_relaxed);
+            stats.morphUntrimmedLength.store(morphKernel != nullptr
+                                             ? static_cast<uint32_t>(morphKernel->getUntrimmedLength()) : 0,
+                                             std::memory_order_relaxed);
+            stats.morphActivePartitions.store(morphKernel != nullptr
+                                              ? static_cast<uint32_t>(morphKernel->getNumActivePartitions()) : 0,
+                                              std::memory_order_relaxed);
+
+            for (uint i = 0; i < 3; ++i)
+                stats.tailDecayTimes[i].store(kernels.lateTail.isEnabled()
+                                              ? static_cast<uint32_t>(kernels.lateTail.decayTimes[i] * 1000.f + 0.5f)
+                                              : 0, std::memory_order_relaxed);
+
+            stats.numLoads.fetch_add(1, std::memory_order_release);
+        }
+
+        // open an IR file, returning its length once resampled, 0 if it cannot be opened
+        size_t openIR(const String& file, ConvolutionIRReader& reader) const
+        {
+            if (! reader.open(file))
+                return 0;
+
+            return static_cast<size_t>(std::ceil(reader.getNumFrames() * sampleRate / reader.getSampleRate()));
+        }
+
+        // get the kernels of an IR file for our layout, with `reader` having the file open.
+        // reusing the spectra from another instance if possible, or from a previous session
+        bool getKernels(const String& file, ConvolutionIRReader& reader, const ConvolutionTrimSettings& trim,
+                        ConvolutionKernelCache::Kernels& kernels)
+        {
+            ConvolutionKernelCache::Key cacheKey;
+
+            if (! cacheKey.init(file, sampleRate, layout, trim))
+            {
+                d_stderr("Failed to open IR file '%s'", file.buffer());
+                return false;
+            }
+
+            ConvolutionKernelCache& cache(ConvolutionKernelCache::getInstance());
+
+            // if another instance is making the same kernels right now, this waits for them
+            if (cache.get(cacheKey, kernels))
+                return true;
+
+            if (! ConvolutionKernelDiskCache::load(cacheKey, kernels))
+            {
+                if (! loadKernels(cacheKey, reader, kernels))
+                {
+                    cache.cancel(cacheKey);
+                    return false;
+                }
+
+                ConvolutionKernelDiskCache::store(cacheKey, kernels);
+            }
+
+            // keep the decoded IR around if someone has it, a later sample rate change can skip reading the file
+            if (kernels.source == nullptr)
+                kernels.source = cache.getSource(cacheKey);
+
+            cache.put(cacheKey, kernels);
+            return true;
+        }
+
+        // trim, resample and partition an IR file, with every channel prepared in parallel.
+        // the file is only decoded if no other kernels made from it are still around, and then only once.
+        bool loadKernels(const ConvolutionKernelCache::Key& cacheKey, ConvolutionIRReader& reader,
+                         ConvolutionKernelCache::Kernels& kernels)
+        {
+            std::shared_ptr<const ConvolutionKernelCache::Source> source(
+                ConvolutionKernelCache::getInstance().getSource(cacheKey));
+
+            if (source == nullptr)
+            {
+                const uint channels = reader.getNumChannels();
+
+                if (channels == 0)
+                    return false;
+
+                ConvolutionKernelCache::Source* const newSource = new ConvolutionKernelCache::Source();
+                source.reset(newSource);
+                newSource->sampleRate = reader.getSampleRate();
+                newSource->numFrames = reader.getNumFrames();
+
+                // 1 channel is used for both sides, 2 channels are left and right,
+                // 4 channels are true stereo as left to left, left to right, right to left and right to right.
+                // anything else uses the 1st channel only.
+                newSource->numChannels = channels == 2 || channels == 4 ? channels : 1;
+
+                // a single pass over the file finds the region to trim, analyzing all used channels together,
+                // and deinterleaves them for the channel jobs.
+                // with a maximum length the decay of the rest is measured too, for the algorithmic tail.
+                const bool limited = cacheKey.trim.maxLength > 0.f;
+                ConvolutionTrimmer trimmer;
+                ConvolutionDecayAnalyzer analyzer;
+                trimmer.reset(newSource->numFrames);
+
+                if (limited)
+                    analyzer.reset(newSource->sampleRate, newSource->numFrames);
+
+                for (uint c = 0; c < newSource->numChannels; ++c)
+                    newSource->channels[c].reserve(newSource->numFrames);
+
+                std::vector<float> chunk(ChannelJob::kChunkFrames * channels);
+
+                while (const size_t frames = reader.read(chunk.data(), ChannelJob::kChunkFrames))
+                {
+                    trimmer.process(chunk.data(), channels, newSource->numChannels, frames);
+
+                    if (limited)
+                        analyzer.process(chunk.data(), channels, newSource->numChannels, frames);
+
+                    for (uint c = 0; c < newSource->numChannels; ++c)
+                    {
+                        std::vector<float>& channel(newSource->channels[c]);
+                        const size_t offset = channel.size();
+                        channel.resize(offset + frames);
+
+                        for (size_t i = 0; i < frames; ++i)
+                            channel[offset + i] = chunk[i * channels + c];
+                    }
+                }
+
+                reader.close();
+
+                newSource->region = trimmer.analyze(newSource->sampleRate, cacheKey.trim);
+
+                if (limited)
+                    newSource->lateTail = analyzer.analyze(newSource->sampleRate, newSource->region.fadeStart,
+                                                           cacheKey.trim.tailFloor);
+
+                // only the trimmed region is kept
+                for (uint c = 0; c < newSource->numChannels; ++c)
+                {
+                    std::vector<float>& channel(newSource->channels[c]);
+                    const size_t end = std::min(newSource->region.end, channel.size());
+                    channel.erase(channel.begin() + end, channel.end());
+                    channel.erase(channel.begin(), channel.begin() + std::min(newSource->region.start, end));
+                    channel.shrink_to_fit();
+                }
+            }
+
+            const uint numBuffers = source->numChannels;
+
+            bool ok = target->setProgress(generation, 0.2f);
+
+            if (ok)
+            {
+                // one kernel per channel, spread over the loader threads, the 1st one usually ends up being done here
+                std::shared_ptr<const ConvolutionKernel> results[4];
+                ScopedPointer<ChannelJob> jobs[4];
+
+                for (uint k = numBuffers; k-- != 0;)
+                {
+                    jobs[k] = new ChannelJob(k, sampleRate, layout, *source);
+                    loader->submitJob(jobs[k].get());
+                }
+
+                for (uint k = 0; k < numBuffers; ++k)
+                {
+                    loader->waitForJob(jobs[k].get());
+                    target->setProgress(generation, 0.2f + 0.7f * (k + 1) / numBuffers);
+                    results[k] = jobs[k]->kernel;
+                    ok = ok && results[k] != nullptr;
+                }
+
+                switch (numBuffers)
+                {
+                case 1:
+                    // both sides share the same immutable spectra, only input and overlap state is per channel
+                    kernels.left = kernels.right = results[0];
+                    break;
+                case 2:
+                    kernels.left = results[0];
+                    kernels.right = results[1];
+                    break;
+                case 4:
+                    kernels.left = results[0];
+                    kernels.leftToRight = results[1];
+                    kernels.rightToLeft = results[2];
+                    kernels.right = results[3];
+                    break;
+                }
+
+                kernels.source = source;
+                kernels.lateTail = source->lateTail;
+            }
+
+            return ok && target->setProgress(generation, 0.9f);
+        }
+
+        DISTRHO_DECLARE_NON_COPYABLE(LoadJob)
+    };
+
+    ConvolutionKernelLoader::SharedInstance loader;
+    ConvolutionStats stats; // must outlive the swapper
+    ConvolutionKernelSwapper kernelSwapper;
+    const std::shared_ptr<LoadTarget> loadTarget;
     Korg35Filter korgFilterL, korgFilterR;
-    Mutex mutex;
+
+    // files, sample rate and buffer size of the last requested load, guarded by the load target mutex
     String loadedFilename;
+    String morphFilename;
+    double loadedSampleRate = 0.0;
+    uint32_t loadedBufferSize = 0;
+
+    // settings used by loads, which can be changed from any thread
+    std::atomic<bool> efficientMode { false };
+    std::atomic<bool> compactKernels { false };
+    std::atomic<bool> lateTail { false };
+    std::atomic<float> loadMorph { 0.f };
 
     bool bypassed = false;
     bool trails = true;
     uint32_t bufferSize = 0;
 
+    // latency reported to the host
+    uint32_t reportedLatency = 0;
+
     // smoothed parameters
     LinearValueSmoother smoothDryLevel;
     LinearValueSmoother smoothWetLevel;
+    LinearValueSmoother smoothMorph;
 
     // buffers for placing highpass signal before convolution
     float* highpassBufL = nullptr;
@@ -577,6 +1323,12 @@ private:
     float* inplaceProcBufL = nullptr;
     float* inplaceProcBufR = nullptr;
 
+    // dry signal delay line, for when the convolution has latency
+    float* dryDelayBufL = nullptr;
+    float* dryDelayBufR = nullptr;
+    uint32_t dryDelaySize = 0;
+    uint32_t dryDelayPosition = 0;
+
     DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OneKnobConvolutionReverbPlugin)
 };
 
@@ -38,6 +38,12 @@ static constexpr const OneKnobAuxiliaryCheckBox kHighPassCheckBox = {
     "Activate to prevent low-band/bassy sounds from being sent to the reverb"
 };
 
+static constexpr const OneKnobAuxiliaryCheckBox kEfficientModeCheckBox = {
+    kParameterEfficientMode,
+    "Efficient Mode",
+    "Activate for lower CPU usage at the cost of some latency, for when the host compensates for it"
+};
+
 static const OneKnobAuxiliarySlider numFieldOpts = {
     kParameterDryLevel,
     "Dry Level",
@@ -51,13 +57,27 @@ static const OneKnobAuxiliaryFileButton fileButtonOpts = {
 
 static const char* kConvolutionLineMeterNames[2] = { "Dry:", "Wet:" };
 
+enum StatusLines {
+    kStatusIR,
+    kStatusPartitions,
+    kStatusExtra,
+    kStatusJobs,
+    kStatusJobTimes,
+    kStatusWaits,
+    kStatusCount
+};
+
+// refresh the stats twice per second, at 60fps idle
+static const uint kStatusRefreshIdles = 30;
+
 // --------------------------------------------------------------------------------------------------------------------
 
 class OneKnobConvolutionReverbUI : public OneKnobUI
 {
 public:
     OneKnobConvolutionReverbUI()
-        : OneKnobUI(kDefaultWidth, kDefaultHeight, kConvolutionLineMeterNames)
+        : OneKnobUI(kDefaultWidth, kDefaultHeight, kConvolutionLineMeterNames),
+          statusIdleCounter(0)
     {
         // setup OneKnob UI
         const Rectangle<uint> mainArea(kSidePanelWidth,
@@ -70,7 +90,13 @@ public:
                                       kDefaultHeight/4,
                                       kDefaultWidth/2 - kSidePanelWidth,
                                       kDefaultHeight*3/4);
-        createAuxiliaryFileButton(auxArea, kHighPassCheckBox, numFieldOpts, fileButtonOpts);
+        createAuxiliaryFileButton(auxArea, kHighPassCheckBox, numFieldOpts, fileButtonOpts, &kEfficientModeCheckBox);
+
+        const Rectangle<uint> statusArea(kSidePanelWidth + 4,
+                                         kDefaultHeight*3/4,
+                                         kDefaultWidth/2 - kSidePanelWidth - 8,
+                                         kDefaultHeight/4 - kSidePanelWidth - 4);
+        createStatusText(statusArea, kStatusCount);
 
         repositionWidgets();
 
@@ -95,6 +121,9 @@ protected:
         case kParameterHighPassFilter:
             setAuxiliaryCheckBoxValue(value);
             break;
+        case kParameterEfficientMode:
+            setAuxiliaryExtraCheckBoxValue(value);
+            break;
         }
 
         repaint();
@@ -108,12 +137,100 @@ protected:
             setMainControlValue(kParameterRanges[kParameterWetLevel].def);
             setAuxiliaryNumFieldValue(kParameterRanges[kParameterDryLevel].def);
             setAuxiliaryCheckBoxValue(kParameterRanges[kParameterHighPassFilter].def > 0.5f);
+            setAuxiliaryExtraCheckBoxValue(kParameterRanges[kParameterEfficientMode].def);
             break;
         }
 
         repaint();
     }
 
+    // -------------------------------------------------------------------
+    // Idle
+
+    void idleCallback() override
+    {
+        OneKnobUI::idleCallback();
+
+        if (++statusIdleCounter < kStatusRefreshIdles)
+            return;
+
+        statusIdleCounter = 0;
+
+        if (const ConvolutionStats* const stats = getSharedStats())
+        {
+            updateStatus(*stats);
+            repaint();
+        }
+    }
+
+private:
+    uint statusIdleCounter;
+
+    void updateStatus(const ConvolutionStats& stats)
+    {
+        char text[128];
+        char time1[32];
+        char time2[32];
+
+        // what trimming did to the last IR loaded
+        if (stats.numLoads.load(std::memory_order_acquire) != 0)
+        {
+            const double msPerSample = 1000.0 / getSampleRate();
+
+            std::snprintf(text, sizeof(text), "IR: %.0f ms of %.0f ms, after %.0f ms delay",
+                          stats.irLength.load(std::memory_order_relaxed) * msPerSample,
+                          stats.irUntrimmedLength.load(std::memory_order_relaxed) * msPerSample,
+                          stats.irDelay.load(std::memory_order_relaxed) * msPerSample);
+            setStatusText(kStatusIR, text);
+
+            std::snprintf(text, sizeof(text), "Partitions: %u of %u, %u active",
+                          stats.irPartitions.load(std::memory_order_relaxed),
+                          stats.irUntrimmedPartitions.load(std::memory_order_relaxed),
+                          stats.irActivePartitions.load(std::memory_order_relaxed));
+            setStatusText(kStatusPartitions, text);
+
+            if (stats.morphLength.load(std::memory_order_relaxed) != 0)
+                std::snprintf(text, sizeof(text), "Morph IR: %.0f ms of %.0f ms, %u active partitions",
+                              stats.morphLength.load(std::memory_order_relaxed) * msPerSample,
+                              stats.morphUntrimmedLength.load(std::memory_order_relaxed) * msPerSample,
+                              stats.morphActivePartitions.load(std::memory_order_relaxed));
+            else if (stats.tailDecayTimes[0].load(std::memory_order_relaxed) != 0)
+                std::snprintf(text, sizeof(text), "Tail decay, low/mid/high: %u/%u/%u ms",
+                              stats.tailDecayTimes[0].load(std::memory_order_relaxed),
+                              stats.tailDecayTimes[1].load(std::memory_order_relaxed),
+                              stats.tailDecayTimes[2].load(std::memory_order_relaxed));
+            else
+                text[0] = '\0';
+            setStatusText(kStatusExtra, text);
+        }
+
+        formatTime(time1, sizeof(time1), stats.maxJobTime.load(std::memory_order_relaxed));
+        std::snprintf(text, sizeof(text), "Jobs: %u, %u late, max %s",
+                      stats.numJobs.load(std::memory_order_relaxed),
+                      stats.numLateJobs.load(std::memory_order_relaxed),
+                      time1);
+        setStatusText(kStatusJobs, text);
+
+        formatTime(time1, sizeof(time1), ConvolutionStats::getPercentile(stats.jobTimes, 0.5));
+        formatTime(time2, sizeof(time2), ConvolutionStats::getPercentile(stats.jobTimes, 0.99));
+        std::snprintf(text, sizeof(text), "Job times: 50%% < %s, 99%% < %s", time1, time2);
+        setStatusText(kStatusJobTimes, text);
+
+        formatTime(time1, sizeof(time1), stats.maxWaitTime.load(std::memory_order_relaxed));
+        formatTime(time2, sizeof(time2), ConvolutionStats::getPercentile(stats.waitTimes, 0.99));
+        std::snprintf(text, sizeof(text), "Audio thread waits: %u, 99%% < %s, max %s",
+                      stats.numWaits.load(std::memory_order_relaxed), time2, time1);
+        setStatusText(kStatusWaits, text);
+    }
+
+    static void formatTime(char* const buffer, const size_t size, const uint32_t us)
+    {
+        if (us == UINT32_MAX)
+            std::snprintf(buffer, size, "inf");
+        else
+            std::snprintf(buffer, size, "%.2f ms", us * 0.001);
+    }
+
     DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OneKnobConvolutionReverbUI)
 };
 
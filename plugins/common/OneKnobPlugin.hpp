@@ -142,6 +142,14 @@ protected:
         lineGraph2.write(v2);
     }
 
+   #ifdef ONEKNOB_SHARED_STATS_TYPE
+    inline void setSharedStats(const ONEKNOB_SHARED_STATS_TYPE& stats)
+    {
+        if (lineGraphActive)
+            lineGraphsData.getDataPointer()->stats.copyFrom(stats);
+    }
+   #endif
+
     // -------------------------------------------------------------------
 
     float parameters[kParameterCount];
@@ -47,6 +47,10 @@ typedef FloatFifoControl<32> OneKnobFloatFifoControl;
 struct OneKnobLineGraphFifos {
     OneKnobFloatFifo v1;
     OneKnobFloatFifo v2;
+   #ifdef ONEKNOB_SHARED_STATS_TYPE
+    // plugin-specific, published by the DSP side for the UI to read
+    ONEKNOB_SHARED_STATS_TYPE stats;
+   #endif
     bool closed;
 };
 
@@ -39,6 +39,7 @@ static inline MATH_CONSTEXPR int lin2dbint(const float value)
 // --------------------------------------------------------------------------------------------------------------------
 
 static const uint kSidePanelWidth = 12;
+static const uint kMaxStatusLines = 6;
 static const char* kDefaultLineMeterNames[2] = { "In:", "Out:" };
 
 // --------------------------------------------------------------------------------------------------------------------
@@ -207,6 +208,7 @@ public:
           blendishMeter2LabelValue(&blendish),
           blendishMeter2Line(&blendish, Color::fromHTML("#c90054")),
           blendishMeter1Line(&blendish, Color(0x3E, 0xB8, 0xBE, 0.75f)),
+          numStatusLines(0),
           firstIdle(true)
     {
         const double scaleFactor = getScaleFactor();
@@ -368,6 +370,14 @@ protected:
                         label->setLabel(rvalue + 1);
     }
 
+   #ifdef ONEKNOB_SHARED_STATS_TYPE
+    // stats published by the DSP side, null if not shared yet
+    const ONEKNOB_SHARED_STATS_TYPE* getSharedStats() const noexcept
+    {
+        return lineGraphsData.isCreatedOrConnected() ? &lineGraphsData.getDataPointer()->stats : nullptr;
+    }
+   #endif
+
     // ----------------------------------------------------------------------------------------------------------------
     // main control
 
@@ -473,6 +483,13 @@ protected:
         blendishAuxOptionCheckBox->setChecked(value > 0.5f, false);
     }
 
+    void setAuxiliaryExtraCheckBoxValue(const float value)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(blendishAuxOptionExtraCheckBox != nullptr,);
+
+        blendishAuxOptionExtraCheckBox->setChecked(value > 0.5f, false);
+    }
+
     // ----------------------------------------------------------------------------------------------------------------
     // aux combobox
 
@@ -522,9 +539,11 @@ protected:
     void createAuxiliaryFileButton(const Rectangle<uint>& area,
                                    const OneKnobAuxiliaryCheckBox& checkBoxOpts,
                                    const OneKnobAuxiliarySlider& numFieldOpts,
-                                   const OneKnobAuxiliaryFileButton& fileButtonOpts)
+                                   const OneKnobAuxiliaryFileButton& fileButtonOpts,
+                                   const OneKnobAuxiliaryCheckBox* const extraCheckBoxOpts = nullptr)
     {
         DISTRHO_SAFE_ASSERT_RETURN(blendishAuxOptionCheckBox == nullptr,);
+        DISTRHO_SAFE_ASSERT_RETURN(blendishAuxOptionExtraCheckBox == nullptr,);
         DISTRHO_SAFE_ASSERT_RETURN(blendishAuxOptionNumberField == nullptr,);
         DISTRHO_SAFE_ASSERT_RETURN(blendishAuxOptionFileButton == nullptr,);
         DISTRHO_SAFE_ASSERT_RETURN(blendishAuxOptionLabel == nullptr,);
@@ -552,6 +571,15 @@ protected:
         label->setLabel("(No file loaded yet)");
         label->setFontSize(9);
 
+        if (extraCheckBoxOpts != nullptr)
+        {
+            BlendishCheckBox* const extraCheckBox = new BlendishCheckBox(&blendish);
+            extraCheckBox->setCallback(this);
+            extraCheckBox->setId(extraCheckBoxOpts->id);
+            extraCheckBox->setLabel(extraCheckBoxOpts->title);
+            blendishAuxOptionExtraCheckBox = extraCheckBox;
+        }
+
         auxOptionArea = getScaledArea(area);
         blendishAuxOptionCheckBox = checkBox;
         blendishAuxOptionNumberField = numField;
@@ -576,6 +604,33 @@ protected:
         blendishAuxOptionLabel = label;
     }
 
+    // ----------------------------------------------------------------------------------------------------------------
+    // status text, small read-only lines of information
+
+    void createStatusText(const Rectangle<uint>& area, const uint numLines)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(numStatusLines == 0,);
+        DISTRHO_SAFE_ASSERT_RETURN(numLines != 0 && numLines <= kMaxStatusLines,);
+
+        for (uint i = 0; i < numLines; ++i)
+        {
+            BlendishLabel* const label = new BlendishLabel(&blendish);
+            label->setColor(Color::fromHTML("#cacacb"));
+            label->setFontSize(8);
+            blendishStatusLabels[i] = label;
+        }
+
+        statusArea = getScaledArea(area);
+        numStatusLines = numLines;
+    }
+
+    void setStatusText(const uint line, const char* const text)
+    {
+        DISTRHO_SAFE_ASSERT_RETURN(line < numStatusLines,);
+
+        blendishStatusLabels[line]->setLabel(text, false);
+    }
+
     // ----------------------------------------------------------------------------------------------------------------
 
     void pushInputMeter(const float value)
@@ -641,6 +696,13 @@ protected:
             auxWidgetPosX = checkBox->getAbsoluteX();
         }
 
+        if (BlendishCheckBox* const checkBox = blendishAuxOptionExtraCheckBox.get())
+        {
+            checkBox->setAbsoluteX(auxOptionArea.getX() + auxOptionArea.getWidth()/2 - checkBox->getWidth()/2);
+            checkBox->setAbsoluteY(auxOptionArea.getY() + auxWidgetHeight + 2);
+            auxWidgetHeight += checkBox->getHeight() + 2;
+        }
+
         if (BlendishComboBox* const comboBox = blendishAuxOptionComboBox.get())
         {
             comboBox->setAbsoluteX(auxOptionArea.getX() + auxOptionArea.getWidth()/2 - comboBox->getWidth()/2);
@@ -673,6 +735,16 @@ protected:
             label->setHeight(auxOptionArea.getHeight() - auxWidgetHeight - 2);
         }
 
+        // status text
+        for (uint i = 0; i < numStatusLines; ++i)
+        {
+            BlendishLabel* const label = blendishStatusLabels[i].get();
+            label->setAbsoluteX(statusArea.getX());
+            label->setAbsoluteY(statusArea.getY() + statusArea.getHeight() * i / numStatusLines);
+            label->setWidth(statusArea.getWidth());
+            label->setHeight(statusArea.getHeight() / numStatusLines);
+        }
+
         // metering
         blendishMeter1Line.setAbsolutePos(kSidePanelWidth,
                                            height / 2 - blendishMeter1Line.getHeight() - kSidePanelWidth);
@@ -704,6 +776,7 @@ private:
     Rectangle<uint> auxOptionArea;
     ScopedPointer<BlendishButtonGroup> blendishAuxOptionButtonGroup;
     ScopedPointer<BlendishCheckBox> blendishAuxOptionCheckBox;
+    ScopedPointer<BlendishCheckBox> blendishAuxOptionExtraCheckBox;
     ScopedPointer<BlendishComboBox> blendishAuxOptionComboBox;
     ScopedPointer<BlendishNumberField> blendishAuxOptionNumberField;
     ScopedPointer<BlendishToolButton> blendishAuxOptionFileButton;
@@ -720,6 +793,11 @@ private:
     BlendishMeterLine blendishMeter2Line;
     BlendishMeterLine blendishMeter1Line;
 
+    // status text
+    Rectangle<uint> statusArea;
+    ScopedPointer<BlendishLabel> blendishStatusLabels[kMaxStatusLines];
+    uint numStatusLines;
+
     // wait until first idle to setup fifo, in case UI is created as test
     bool firstIdle;
 
@@ -763,11 +841,18 @@ private:
 
     void buttonClicked(SubWidget* const widget, int) override
     {
+        BlendishCheckBox* checkBox;
+
         if (blendishAuxOptionCheckBox == widget)
-            if (BlendishCheckBox* const checkBox = blendishAuxOptionCheckBox.get())
-                setParameterValue(checkBox->getId(),
-                                  checkBox->isChecked() ? kParameterRanges[checkBox->getId()].max
-                                                        : kParameterRanges[checkBox->getId()].min);
+            checkBox = blendishAuxOptionCheckBox.get();
+        else if (blendishAuxOptionExtraCheckBox == widget)
+            checkBox = blendishAuxOptionExtraCheckBox.get();
+        else
+            return;
+
+        setParameterValue(checkBox->getId(),
+                          checkBox->isChecked() ? kParameterRanges[checkBox->getId()].max
+                                                : kParameterRanges[checkBox->getId()].min);
     }
 
     void knobDragStarted(SubWidget* const widget) override